@@ -1,12 +1,17 @@
 /// file name: VLM.c
 /// author: Gabe Rippel (gwr3294)
 /// encodes strings based on their freqeuncy.
-/// doesn't work for decoding, though. That's a bit of a problem.
+/// prints the code report by default; -e and -d encode and decode.
 
+#define _POSIX_C_SOURCE 200809L    // for sysconf
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "node_heap.h"
+#include "vlc_codec.h"
+#include "vlc_server.h"
 
 #define MAXSYMS 256
 #define MAX_CODE 32
@@ -49,59 +54,261 @@ static int basic_log(int length) {
 }
 
 
-int main(void) {
+/// usage prints how to run the program to stderr.
+static void usage(void) {
+    fprintf(stderr, "usage: VLC [-e | -d] [-n streams] [-p policy] [-s chunks]"
+            " [-l] [-t] [-j threads] [-v] < input > output\n");
+    fprintf(stderr, "       VLC -S socket [-j workers] [-v]\n");
+    fprintf(stderr, "    with no option, print the code report for input\n");
+    fprintf(stderr, "    -e  encode input, which must be a seekable file\n");
+    fprintf(stderr, "    -d  decode input written by -e\n");
+    fprintf(stderr, "    -n  interleaved bitstreams per block (1-%d, default %d)\n",
+            VLC_MAX_STREAMS, VLC_STREAMS);
+    fprintf(stderr, "    -p  how each block picks its coder: size (default),"
+            " speed, vlc or ans\n");
+    fprintf(stderr, "    -s  build the code from this many evenly spaced"
+            " chunks of input, reading it once\n");
+    fprintf(stderr, "    -l  code line lengths apart from the text,"
+            " leaving newlines out of the code\n");
+    fprintf(stderr, "    -t  pass each block through BWT, move-to-front and"
+            " run-length coding first\n");
+    fprintf(stderr, "    -j  coding threads (default: one per CPU);"
+            " reading and writing get their own\n");
+    fprintf(stderr, "    -S  serve encode, decode and analyze requests on a"
+            " Unix domain socket\n");
+    fprintf(stderr, "    -v  print statistics, including pipeline stalls,"
+            " to stderr\n");
+}
+
+/// parse_policy turns a -p argument into a VLC_POLICY value, or -1.
+static int parse_policy(const char * name) {
+    if (strcmp(name, "size") == 0) {
+        return (VLC_POLICY_SIZE);
+    } else if (strcmp(name, "speed") == 0) {
+        return (VLC_POLICY_SPEED);
+    } else if (strcmp(name, "vlc") == 0) {
+        return (VLC_POLICY_VLC);
+    } else if (strcmp(name, "ans") == 0) {
+        return (VLC_POLICY_ANS);
+    }
+    return (-1);
+}
+
+/// print_stalls reports how often each pipeline stage waited on another.
+/// a reader that stalls is ahead of the coders; coders that stall are
+/// waiting on the disk.
+static void print_stalls(const VlcStats * stats) {
+    fprintf(stderr, "read stalls:\t%zu\ncode stalls:\t%zu\n"
+            "write stalls:\t%zu\n", stats -> read_stalls,
+            stats -> code_stalls, stats -> write_stalls);
+}
+
+/// print_sample_cost compares the code built from a sample with the one
+/// the exact histogram, tallied while coding, would have given. each side
+/// is costed the way its own policy would code it, since a sampled
+/// histogram can tip the choice between VLC and ANS.
+static void print_sample_cost(const VlcCoder * coder, VlcStats * stats,
+                              int lines, size_t sampled) {
     static Heap heap;
-    heap_init(&heap);
     static Symbol symbols[MAXSYMS];
+    static VlcCoder exact;
+    int sampled_method;
+    int exact_method;
+    if (lines) {
+        stats -> counts['\n'] = 0;
+    }
+    size_t length_of_heap = vlc_symbols(stats -> counts, 0, symbols);
+    fprintf(stderr, "bytes sampled:\t%zu\n", sampled);
+    if (vlc_coder_init(&exact, &heap, length_of_heap, symbols,
+                       coder -> streams, coder -> policy) != 0) {
+        fprintf(stderr, "exact code:\tcannot be built\n");
+        return;
+    }
+    double sampled_bits = vlc_coder_cost(coder, stats -> counts,
+                                         &sampled_method);
+    double exact_bits = vlc_coder_cost(&exact, stats -> counts,
+                                       &exact_method);
+    fprintf(stderr, "sampled code:\t%.0f bytes (%s)\n"
+            "exact code:\t%.0f bytes (%s)\n", sampled_bits / 8,
+            sampled_method == VLC_METHOD_ANS ? "ANS" : "VLC", exact_bits / 8,
+            exact_method == VLC_METHOD_ANS ? "ANS" : "VLC");
+    fprintf(stderr, "sample cost:\t%.2f%%\n", exact_bits > 0 ?
+            100 * (sampled_bits - exact_bits) / exact_bits : 0.0);
+}
 
-    int length_of_heap = read_symbols(MAXSYMS, symbols);
-    heap_make(&heap, length_of_heap, symbols);
-    
-    while (heap.size > 1) {
-        Node lowest = heap_remove(&heap);
-        Node sec_lowest = heap_remove(&heap);
-        /// yes, it does it backwards. I know.
-        /// this is intentional & I'll reverse it when it's time to print.
-        /// so long as the program works, right?
-        for (size_t i = 0; i < lowest.num_valid; i++) {
-            for (size_t j = 0; j < MAX_CODE; j ++) {
-                if (lowest.syms[i].codeword[j] == NUL) {
-                    lowest.syms[i].codeword[j] = '0';
-                    break;
-                }
+/// encode codes standard input to standard output.
+/// the histogram takes one pass; the input is then rewound and read again,
+/// so nothing is held in memory beyond a block. with samples, only that
+/// many chunks are read for the histogram, so the input is read about
+/// once. transformed blocks carry their own tables, so then the input is
+/// read once and may be a pipe. when lines are split, '\n' never reaches
+/// the code and is left out.
+static int encode(size_t streams, int policy, size_t samples, int lines,
+                  int transform, size_t threads, int verbose) {
+    static Heap heap;
+    static Symbol symbols[MAXSYMS];
+    static VlcCoder coder;
+    VlcStats stats;
+    memset(&stats, 0, sizeof(stats));
+    fpos_t start;
+    size_t length_of_heap = 0;
+    size_t sampled = 0;
+    if (!transform) {
+        if (fgetpos(stdin, &start) != 0) {
+            fprintf(stderr, "VLC: encoding needs a seekable input file\n");
+            return (EXIT_FAILURE);
+        }
+        if (samples > 0) {
+            length_of_heap = sample_symbols(MAXSYMS, symbols, samples,
+                                            &sampled);
+            if (length_of_heap == 0) {
+                fprintf(stderr, "VLC: sampling needs a seekable input file\n");
+                return (EXIT_FAILURE);
             }
+        } else {
+            length_of_heap = read_symbols(MAXSYMS, symbols);
         }
-        for (size_t i = 0; i <  sec_lowest.num_valid; i ++) {
-            for (size_t j = 0; j < MAX_CODE; j++) {
-                if (sec_lowest.syms[i].codeword[j] == NUL) {
-                    sec_lowest.syms[i].codeword[j] = '1';
-                    break;
-                }
+    }
+    if (lines) {
+        size_t kept = 0;
+        for (size_t i = 0; i < length_of_heap; i ++) {
+            if (symbols[i].symbol != '\n') {
+                symbols[kept ++] = symbols[i];
             }
         }
+        length_of_heap = kept;
+    }
+    if (vlc_coder_init(&coder, &heap, length_of_heap, symbols,
+                       streams, policy) != 0) {
+        fprintf(stderr, "VLC: cannot build a code\n");
+        return (EXIT_FAILURE);
+    }
+    coder.lines = lines;
+    coder.transform = transform;
+    coder.threads = threads;
+    coder.samples = transform ? 0 : samples;
+    if ((!transform && fsetpos(stdin, &start) != 0)
+        || vlc_encode_file(&coder, stdin, stdout, &stats) != 0
+        || fflush(stdout) != 0) {
+        fprintf(stderr, "VLC: encoding failed\n");
+        return (EXIT_FAILURE);
+    }
+    if (verbose) {
+        fprintf(stderr, "bytes in:\t%zu\nbytes out:\t%zu\n",
+                stats.bytes_in, stats.bytes_out);
+        fprintf(stderr, "VLC blocks:\t%zu\nANS blocks:\t%zu\n",
+                stats.vlc_blocks, stats.ans_blocks);
+        fprintf(stderr, "BWT blocks:\t%zu\n", stats.bwt_blocks);
+        if (lines) {
+            fprintf(stderr, "line blocks:\t%zu\nline bytes:\t%zu\n",
+                    stats.line_blocks, stats.line_bytes);
+        }
+        if (coder.samples > 0) {
+            print_sample_cost(&coder, &stats, lines, sampled);
+        }
+        print_stalls(&stats);
+    }
+    return (EXIT_SUCCESS);
+}
+
+/// decode turns standard input written by encode back into the original.
+static int decode(size_t threads, int verbose) {
+    VlcStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (vlc_decode_file(stdin, stdout, threads, &stats) != 0
+        || fflush(stdout) != 0) {
+        fprintf(stderr, "VLC: input is not a valid encoded file\n");
+        return (EXIT_FAILURE);
+    }
+    if (verbose) {
+        fprintf(stderr, "bytes in:\t%zu\nbytes out:\t%zu\n",
+                stats.bytes_in, stats.bytes_out);
+        print_stalls(&stats);
+    }
+    return (EXIT_SUCCESS);
+}
 
-        Node replacement;
-        replacement.frequency = lowest.frequency + sec_lowest.frequency;
-        replacement.num_valid = lowest.num_valid + sec_lowest.num_valid;
-        
 
-        for (size_t i = 0; i < lowest.num_valid; i ++) {
-            replacement.syms[i] = lowest.syms[i];
+int main(int argc, char * argv[]) {
+    char mode = 'r';
+    const char * socket_path = NULL;
+    size_t streams = VLC_STREAMS;
+    int policy = VLC_POLICY_SIZE;
+    size_t samples = 0;
+    int lines = 0;
+    int transform = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = cpus > 0 ? (size_t)(cpus) : 1;
+    int verbose = 0;
+    for (int i = 1; i < argc; i ++) {
+        if (strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "-d") == 0) {
+            mode = argv[i][1];
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            i ++;
+            mode = 'S';
+            socket_path = argv[i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            i ++;
+            if (atoi(argv[i]) < 1) {
+                usage();
+                return (EXIT_FAILURE);
+            }
+            samples = (size_t)(atoi(argv[i]));
+        } else if (strcmp(argv[i], "-l") == 0) {
+            lines = 1;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            transform = 1;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            i ++;
+            if (atoi(argv[i]) < 1) {
+                usage();
+                return (EXIT_FAILURE);
+            }
+            threads = (size_t)(atoi(argv[i]));
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            i ++;
+            streams = (size_t)(atoi(argv[i]));
+            if (streams < 1 || streams > VLC_MAX_STREAMS) {
+                usage();
+                return (EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            i ++;
+            policy = parse_policy(argv[i]);
+            if (policy < 0) {
+                usage();
+                return (EXIT_FAILURE);
+            }
+        } else {
+            usage();
+            return (EXIT_FAILURE);
         }
-        for (size_t j = lowest.num_valid; j < replacement.num_valid; j++) {
-            replacement.syms[j] = sec_lowest.syms[j - lowest.num_valid];
+    }
+    if (mode == 'e') {
+        return (encode(streams, policy, samples, lines, transform,
+                       threads, verbose));
+    }
+    if (mode == 'd') {
+        return (decode(threads, verbose));
+    }
+    if (mode == 'S') {
+        if (vlc_serve(socket_path, threads, verbose) != 0) {
+            fprintf(stderr, "VLC: cannot serve on %s\n", socket_path);
+            return (EXIT_FAILURE);
         }
-
-        heap_add(&heap, replacement);
+        return (EXIT_SUCCESS);
     }
-    Node final_node;
+
+    static Heap heap;
+    heap_init(&heap);
+    static Symbol symbols[MAXSYMS];
+
+    size_t length_of_heap = read_symbols(MAXSYMS, symbols);
+    heap_make(&heap, length_of_heap, symbols);
     /// now we printin'
-    if (heap.size == 0) {
-        final_node.frequency = 0;
-        final_node.num_valid = 0;
-    } else {
-        final_node = heap_remove(&heap);
-    }
+    Node final_node = vlc_tree(&heap);
     size_t code_len = 0;
     for (size_t i = 0; i < final_node.num_valid; i++) {
         if (strlen(final_node.syms[i].codeword) > code_len) {
@@ -110,8 +317,9 @@ int main(void) {
     }
     printf("Variable Length Code Information\n================================\n");
 
-    int total_bytes = 0;
-    int total_characters = 0;
+    /// these are size_t so that inputs past 2 GB don't overflow the totals.
+    size_t total_bytes = 0;
+    size_t total_characters = 0;
     /// code_len is the size of the longest string.
     for (size_t i = 0; i < final_node.num_valid; i++) {
         Symbol man = final_node.syms[i];
@@ -123,7 +331,7 @@ int main(void) {
         prepend(man.codeword, code_len);
         total_characters += man.frequency;
         if (man.symbol > 127) {
-            printf("symbol: '0x%x'\tfrequency:\t\t%lu\tcodeword:%s\n", man.symbol, man.frequency, man.codeword);
+            printf("symbol: '0x%x'\tfrequency:\t\t%zu\tcodeword:%s\n", man.symbol, man.frequency, man.codeword);
         } else {
             printf("symbol: '");
             if (man.symbol == '\n') {
@@ -133,11 +341,11 @@ int main(void) {
             } else {
                 printf("%c", man.symbol);
             }
-            printf("'\tfrequency:\t\t%lu\tcodeword:%s\n", man.frequency, man.codeword);
+            printf("'\tfrequency:\t\t%zu\tcodeword:%s\n", man.frequency, man.codeword);
         }
     }
     printf("\n");
-    float avg = (float)(total_bytes) / (float)(total_characters);
+    double avg = (double)(total_bytes) / (double)(total_characters);
     printf("Average VLC code length:\t%.4f\n", avg);
     int avg2 = basic_log(final_node.num_valid);
     if (avg2 == -1) {
@@ -145,8 +353,8 @@ int main(void) {
     } else {
         printf("Fixed length code length:\t%.4f\n", (float)(avg2));
     }
-    printf("Longest variable code length:\t%ld\n", code_len);
-    printf("Node cumulative frequency:\t%d\n", total_characters);
-    printf("Number of distinct symbols:\t%ld\n", final_node.num_valid);
+    printf("Longest variable code length:\t%zu\n", code_len);
+    printf("Node cumulative frequency:\t%zu\n", total_characters);
+    printf("Number of distinct symbols:\t%zu\n", final_node.num_valid);
 }
 
@@ -0,0 +1,204 @@
+/// file: ans_codec.c
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// table-based asymmetric numeral system coder. symbols are spread over
+/// ANS_SIZE states in proportion to their normalized frequencies; the
+/// encoder walks the block backwards so the decoder can read it forwards.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ans_codec.h"
+#include "bit_io.h"
+
+/// floor_log2 returns the index of the highest set bit of a nonzero value.
+static unsigned floor_log2(uint32_t value) {
+    unsigned log = 0;
+    while (value >>= 1) {
+        log ++;
+    }
+    return (log);
+}
+
+
+/// ans_normalize scales a histogram so that it sums to ANS_SIZE.
+///
+void ans_normalize(size_t length, const Symbol syms[], uint16_t norm[]) {
+    memset(norm, 0, MAX_SYMS * sizeof(norm[0]));
+    if (length == 0) {
+        return;
+    }
+    /// a symbol read_symbols counted down to 0 still has to be codable.
+    size_t total = 0;
+    for (size_t i = 0; i < length; i ++) {
+        total += syms[i].frequency > 0 ? syms[i].frequency : 1;
+    }
+    size_t sum = 0;
+    for (size_t i = 0; i < length; i ++) {
+        size_t freq = syms[i].frequency > 0 ? syms[i].frequency : 1;
+        size_t share = (size_t)((double)(freq) * ANS_SIZE / (double)(total));
+        if (share == 0) {
+            share = 1;
+        }
+        norm[syms[i].symbol] = (uint16_t)(share);
+        sum += share;
+    }
+    /// rounding leaves the sum a little off; the largest share absorbs it,
+    /// since it changes that symbol's cost the least.
+    while (sum != ANS_SIZE) {
+        int largest = 0;
+        for (int s = 1; s < MAX_SYMS; s ++) {
+            if (norm[s] > norm[largest]) {
+                largest = s;
+            }
+        }
+        if (sum < ANS_SIZE) {
+            norm[largest] += (uint16_t)(ANS_SIZE - sum);
+            sum = ANS_SIZE;
+        } else {
+            norm[largest] --;
+            sum --;
+        }
+    }
+}
+
+
+/// ans_code_init builds the encode and decode tables for norm.
+/// all-zero norm is the code of an empty input and builds no tables.
+///
+int ans_code_init(AnsCode * code, const uint16_t norm[]) {
+    memset(code, 0, sizeof(*code));
+    size_t sum = 0;
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        sum += norm[s];
+    }
+    if (sum == 0) {
+        return (0);
+    }
+    if (sum != ANS_SIZE) {
+        return (-1);
+    }
+
+    /// spread each symbol's states across the table with an odd step,
+    /// which visits every state once.
+    unsigned char spread[ANS_SIZE];
+    unsigned pos = 0;
+    unsigned step = (ANS_SIZE >> 1) + (ANS_SIZE >> 3) + 3;
+    unsigned start = 0;
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        code -> norm[s] = norm[s];
+        code -> symbols += norm[s] > 0;
+        code -> start[s] = (uint16_t)(start);
+        start += norm[s];
+        if (norm[s] > 0) {
+            code -> shift[s] = (unsigned char)(ANS_LOG - floor_log2(norm[s]));
+            code -> threshold[s] = (uint32_t)(norm[s]) << code -> shift[s];
+        }
+        for (unsigned k = 0; k < norm[s]; k ++) {
+            spread[pos] = (unsigned char)(s);
+            pos = (pos + step) & (ANS_SIZE - 1);
+        }
+    }
+
+    /// the k-th state holding a symbol decodes to x = norm + k, and the
+    /// encoder maps that same x back to the state.
+    uint32_t seen[MAX_SYMS];
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        seen[s] = norm[s];
+    }
+    for (unsigned state = 0; state < ANS_SIZE; state ++) {
+        unsigned char s = spread[state];
+        uint32_t x = seen[s] ++;
+        unsigned bits = ANS_LOG - floor_log2(x);
+        code -> table[state].symbol = s;
+        code -> table[state].bits = (unsigned char)(bits);
+        code -> table[state].base = (uint16_t)((x << bits) - ANS_SIZE);
+        code -> next[code -> start[s] + x - norm[s]] = (uint16_t)(ANS_SIZE + state);
+    }
+    return (0);
+}
+
+
+/// ans_cost estimates the bits ans_encode_block will write for a block.
+///
+double ans_cost(const AnsCode * code, const size_t counts[]) {
+    double bits = ANS_LOG;
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        if (counts[s] == 0) {
+            continue;
+        }
+        if (code -> norm[s] == 0) {
+            return (HUGE_VAL);
+        }
+        bits += (double)(counts[s]) * (ANS_LOG - log2(code -> norm[s]));
+    }
+    return (bits);
+}
+
+
+/// ans_block_bound is the most bytes ans_encode_block can write.
+///
+size_t ans_block_bound(size_t count) {
+    return ((count + 1) * ANS_LOG / 8 + 16);
+}
+
+
+/// ans_encode_block codes count bytes with a single ANS state.
+/// the bits each step writes are kept packed as (value << 4 | length),
+/// since a step writes at most ANS_LOG bits.
+///
+size_t ans_encode_block(const AnsCode * code, const unsigned char * in,
+                        size_t count, unsigned char * out) {
+    uint16_t * steps = malloc((count + 1) * sizeof(uint16_t));
+    if (steps == NULL) {
+        return (0);
+    }
+    uint32_t state = ANS_SIZE;
+    for (size_t i = count; i > 0; i --) {
+        unsigned char s = in[i - 1];
+        unsigned bits = code -> shift[s] - 1u + (state >= code -> threshold[s]);
+        steps[i - 1] = (uint16_t)(((state & ((1u << bits) - 1)) << 4) | bits);
+        state = code -> next[code -> start[s] + (state >> bits) - code -> norm[s]];
+    }
+
+    BitWriter w = { out, 0, 0, 0 };
+    put_bits(&w, state - ANS_SIZE, ANS_LOG);
+    for (size_t i = 0; i < count; i ++) {
+        put_bits(&w, steps[i] >> 4, steps[i] & 15);
+    }
+    flush_bits(&w);
+    free(steps);
+    return (w.pos);
+}
+
+
+/// ans_decode_block undoes ans_encode_block.
+/// a step reads at most ANS_LOG bits, so one refill serves four steps.
+///
+int ans_decode_block(const AnsCode * code, const unsigned char * in,
+                     size_t size, unsigned char * out, size_t count) {
+    BitReader r = { in, 0, size, 0, 0 };
+    refill(&r);
+    uint32_t state = get_bits(&r, ANS_LOG);
+    const AnsEntry * table = code -> table;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        refill(&r);
+        for (size_t k = 0; k < 4; k ++) {
+            AnsEntry entry = table[state];
+            out[i + k] = entry.symbol;
+            state = entry.base + get_bits(&r, entry.bits);
+        }
+    }
+    refill(&r);
+    for (; i < count; i ++) {
+        AnsEntry entry = table[state];
+        out[i] = entry.symbol;
+        state = entry.base + get_bits(&r, entry.bits);
+    }
+    /// the encoder started from the first state, so a good block ends there.
+    if (state != 0 || r.pos * 8 - r.count > size * 8) {
+        return (-1);
+    }
+    return (0);
+}
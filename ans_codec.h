@@ -0,0 +1,121 @@
+/// file: ans_codec.h
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// a table-based asymmetric numeral system (tANS) coder.
+/// it codes from the same histogram as the heap-built code, but spends
+/// fractional bits per symbol, which pays off when one symbol dominates.
+
+#ifndef ANS_CODEC_H
+#define ANS_CODEC_H
+
+#include <stdint.h>
+#include "node_heap.h"
+
+/// ANS_LOG is log2 of the table size; normalized frequencies sum to 1 << ANS_LOG.
+///
+#define ANS_LOG   12
+
+/// ANS_SIZE is the number of states in the coding table.
+///
+#define ANS_SIZE   (1 << ANS_LOG)
+
+/// The AnsEntry structure is one decoder state: the <code>symbol</code>
+/// it emits, the number of <code>bits</code> to read next, and the
+/// <code>base</code> those bits are added to for the next state.
+///
+typedef struct AnsEntry_S {
+    /// first state the next bits are added to.
+    uint16_t base;
+
+    /// symbol decoded in this state.
+    unsigned char symbol;
+
+    /// number of bits read for the next state.
+    unsigned char bits;
+} AnsEntry;
+
+/// The AnsCode structure holds the encode and decode tables built from
+/// a normalized histogram:
+/// <ul><li><code>norm</code>, each byte's share of the ANS_SIZE states,
+/// and <code>symbols</code>, how many bytes have a share,
+/// <li><code>start</code>, <code>shift</code> and <code>threshold</code>,
+/// where each byte's states begin in <code>next</code> and how many bits
+/// the encoder writes for it, and
+/// <li><code>next</code> and <code>table</code>, the encoder's state
+/// transitions and the decoder's states.</ul>
+///
+typedef struct AnsCode_S {
+    /// normalized frequency of each byte value, 0 if it is not coded.
+    uint16_t norm[MAX_SYMS];
+
+    /// number of byte values with a nonzero norm; 0 for an empty code.
+    unsigned symbols;
+
+    /// offset of each byte's transitions in next.
+    uint16_t start[MAX_SYMS];
+
+    /// bits written for a byte when the state is at or above its threshold.
+    unsigned char shift[MAX_SYMS];
+
+    /// state at which a byte's encoding writes shift bits instead of shift-1.
+    uint32_t threshold[MAX_SYMS];
+
+    /// encoder transitions: the next state for each (byte, reduced state).
+    uint16_t next[ANS_SIZE];
+
+    /// decoder states.
+    AnsEntry table[ANS_SIZE];
+} AnsCode;
+
+/// ans_normalize scales a histogram so that it sums to ANS_SIZE.
+/// Every symbol in syms keeps at least one state, even one whose
+/// count is 0, so everything read_symbols saw stays codable.
+/// @param length number of valid entries in syms
+/// @param syms histogram filled by read_symbols
+/// @param norm array of MAX_SYMS normalized frequencies filled in
+///
+void ans_normalize( size_t length, const Symbol syms[], uint16_t norm[] );
+
+/// ans_code_init builds the encode and decode tables for norm.
+/// @param code pointer to the code structure to fill
+/// @param norm MAX_SYMS normalized frequencies
+/// @return 0 on success, -1 if norm does not sum to ANS_SIZE
+///
+int ans_code_init( AnsCode * code, const uint16_t norm[] );
+
+/// ans_cost estimates the bits ans_encode_block will write for a block.
+/// @param code the code to estimate with
+/// @param counts MAX_SYMS byte counts of the block
+/// @return the estimated size in bits
+///
+double ans_cost( const AnsCode * code, const size_t counts[] );
+
+/// ans_block_bound is the most bytes ans_encode_block can write.
+/// @param count number of input bytes in the block
+///
+size_t ans_block_bound( size_t count );
+
+/// ans_encode_block codes count bytes with a single ANS state.
+/// The state runs backwards over the block; the bits are then written
+/// in the order the decoder reads them.
+/// @param code the code to write with
+/// @param in the bytes to code; every byte must have a nonzero norm
+/// @param count number of bytes in in
+/// @param out buffer of at least ans_block_bound(count) bytes
+/// @return the number of bytes written to out, or 0 if out of memory
+///
+size_t ans_encode_block( const AnsCode * code, const unsigned char * in,
+                         size_t count, unsigned char * out );
+
+/// ans_decode_block undoes ans_encode_block.
+/// @param code the code the block was written with
+/// @param in the encoded block
+/// @param size number of bytes in in
+/// @param out buffer for the count decoded bytes
+/// @param count number of bytes the block decodes to
+/// @return 0 on success, -1 if the block is corrupt
+///
+int ans_decode_block( const AnsCode * code, const unsigned char * in,
+                      size_t size, unsigned char * out, size_t count );
+
+#endif // ANS_CODEC_H
@@ -0,0 +1,111 @@
+/// file: bit_io.h
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// little endian byte helpers and the least-significant-bit-first
+/// bit writer and reader shared by the entropy coders.
+/// everything here is static inline so the hot loops can inline it.
+
+#ifndef BIT_IO_H
+#define BIT_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// The BitWriter structure appends codes least significant bit first.
+/// bits holds count pending bits that haven't been stored yet.
+///
+typedef struct BitWriter_S {
+    unsigned char * out;
+    size_t pos;
+    uint64_t bits;
+    unsigned count;
+} BitWriter;
+
+/// The BitReader structure reads one bitstream least significant bit first.
+/// bits always holds count valid bits; pos runs past limit only when
+/// the stream is exhausted, and those missing bytes read as zero.
+///
+typedef struct BitReader_S {
+    const unsigned char * in;
+    size_t pos;
+    size_t limit;
+    uint64_t bits;
+    unsigned count;
+} BitReader;
+
+/// put_u32 stores value little endian at out.
+static inline void put_u32(unsigned char * out, uint32_t value) {
+    for (int i = 0; i < 4; i ++) {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+/// get_u32 loads a little endian value from in.
+static inline uint32_t get_u32(const unsigned char * in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i ++) {
+        value |= (uint32_t)(in[i]) << (8 * i);
+    }
+    return (value);
+}
+
+/// get_u64 loads a little endian value from in.
+/// written out in full so the compiler turns it into a single load.
+static inline uint64_t get_u64(const unsigned char * in) {
+    return ((uint64_t)(in[0]) | (uint64_t)(in[1]) << 8
+            | (uint64_t)(in[2]) << 16 | (uint64_t)(in[3]) << 24
+            | (uint64_t)(in[4]) << 32 | (uint64_t)(in[5]) << 40
+            | (uint64_t)(in[6]) << 48 | (uint64_t)(in[7]) << 56);
+}
+
+/// put_bits appends the low length bits of code to the writer.
+static inline void put_bits(BitWriter * w, uint32_t code, unsigned length) {
+    w -> bits |= (uint64_t)(code) << w -> count;
+    w -> count += length;
+    if (w -> count >= 32) {
+        put_u32(w -> out + w -> pos, (uint32_t)(w -> bits));
+        w -> pos += 4;
+        w -> bits >>= 32;
+        w -> count -= 32;
+    }
+}
+
+/// flush_bits stores whatever partial bytes the writer still holds.
+static inline void flush_bits(BitWriter * w) {
+    while (w -> count > 0) {
+        w -> out[w -> pos] = (unsigned char)(w -> bits);
+        w -> pos ++;
+        w -> bits >>= 8;
+        w -> count = w -> count > 8 ? w -> count - 8 : 0;
+    }
+}
+
+/// refill tops the reader up to at least 56 bits.
+/// the fast path loads 8 bytes at once; near the end of the stream
+/// bytes are taken one at a time so nothing past limit is touched.
+static inline void refill(BitReader * r) {
+    if (r -> pos + 8 <= r -> limit) {
+        r -> bits |= get_u64(r -> in + r -> pos) << r -> count;
+        r -> pos += (63 - r -> count) >> 3;
+        r -> count |= 56;
+    } else {
+        while (r -> count <= 56) {
+            if (r -> pos < r -> limit) {
+                r -> bits |= (uint64_t)(r -> in[r -> pos]) << r -> count;
+            }
+            r -> pos ++;
+            r -> count += 8;
+        }
+    }
+}
+
+/// get_bits removes the low length bits of a refilled reader.
+/// length must be less than 32 and no more than the reader holds.
+static inline uint32_t get_bits(BitReader * r, unsigned length) {
+    uint32_t value = (uint32_t)(r -> bits) & ((1u << length) - 1);
+    r -> bits >>= length;
+    r -> count -= length;
+    return (value);
+}
+
+#endif // BIT_IO_H
@@ -0,0 +1,353 @@
+/// file: bwt.c
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// Burrows-Wheeler transform, move-to-front and run-length coding.
+/// the suffix array behind the transform is built with SA-IS
+/// (Nong, Zhang and Chan), which takes time linear in the block size.
+
+#include <stdlib.h>
+#include <string.h>
+#include "bwt.h"
+
+/// RLE_RUN is how many equal bytes rle_encode writes before a count.
+///
+#define RLE_RUN 4
+
+/// RLE_MAX is the most further copies one count byte can stand for.
+///
+#define RLE_MAX 255
+
+/// bucket_bounds sets bucket[c] to the start (or end, if ends is set)
+/// of the suffix array region for suffixes starting with c.
+static void bucket_bounds(const int32_t * t, int32_t n, int32_t k,
+                          int32_t * bucket, int ends) {
+    memset(bucket, 0, (size_t)(k) * sizeof(int32_t));
+    for (int32_t i = 0; i < n; i ++) {
+        bucket[t[i]] ++;
+    }
+    int32_t sum = 0;
+    for (int32_t c = 0; c < k; c ++) {
+        sum += bucket[c];
+        bucket[c] = ends ? sum : sum - bucket[c];
+    }
+}
+
+/// induce sorts the L-type suffixes from the placed S-type ones,
+/// then the S-type suffixes from the sorted L-type ones.
+/// type[i] is 1 for S-type and 0 for L-type.
+static void induce(const int32_t * t, int32_t * sa, const unsigned char * type,
+                   int32_t n, int32_t k, int32_t * bucket) {
+    bucket_bounds(t, n, k, bucket, 0);
+    for (int32_t i = 0; i < n; i ++) {
+        int32_t j = sa[i] - 1;
+        if (sa[i] > 0 && !type[j]) {
+            sa[bucket[t[j]] ++] = j;
+        }
+    }
+    bucket_bounds(t, n, k, bucket, 1);
+    for (int32_t i = n - 1; i >= 0; i --) {
+        int32_t j = sa[i] - 1;
+        if (sa[i] > 0 && type[j]) {
+            sa[-- bucket[t[j]]] = j;
+        }
+    }
+}
+
+/// is_lms tells whether position i is the leftmost S of an S-type run.
+static int is_lms(const unsigned char * type, int32_t i) {
+    return (i > 0 && type[i] && !type[i - 1]);
+}
+
+/// sais sorts the n suffixes of t into sa. The symbols of t are in
+/// [0, k) and the last one is a 0 that appears nowhere else.
+/// returns 0, or -1 if out of memory.
+static int sais(const int32_t * t, int32_t * sa, int32_t n, int32_t k) {
+    if (n == 1) {
+        sa[0] = 0;
+        return (0);
+    }
+    unsigned char * type = malloc((size_t)(n));
+    int32_t * bucket = malloc((size_t)(k) * sizeof(int32_t));
+    if (type == NULL || bucket == NULL) {
+        free(type);
+        free(bucket);
+        return (-1);
+    }
+    type[n - 1] = 1;
+    for (int32_t i = n - 2; i >= 0; i --) {
+        type[i] = t[i] < t[i + 1] || (t[i] == t[i + 1] && type[i + 1]);
+    }
+
+    /// sort the LMS substrings by placing them at their bucket ends
+    /// and inducing the rest.
+    bucket_bounds(t, n, k, bucket, 1);
+    for (int32_t i = 0; i < n; i ++) {
+        sa[i] = -1;
+    }
+    for (int32_t i = 1; i < n; i ++) {
+        if (is_lms(type, i)) {
+            sa[-- bucket[t[i]]] = i;
+        }
+    }
+    induce(t, sa, type, n, k, bucket);
+
+    /// gather the sorted LMS positions and name each distinct substring.
+    int32_t n1 = 0;
+    for (int32_t i = 0; i < n; i ++) {
+        if (is_lms(type, sa[i])) {
+            sa[n1 ++] = sa[i];
+        }
+    }
+    for (int32_t i = n1; i < n; i ++) {
+        sa[i] = -1;
+    }
+    int32_t names = 0;
+    int32_t prev = -1;
+    for (int32_t i = 0; i < n1; i ++) {
+        int32_t pos = sa[i];
+        int diff = 0;
+        for (int32_t d = 0; ; d ++) {
+            if (prev == -1 || t[pos + d] != t[prev + d]
+                || type[pos + d] != type[prev + d]) {
+                diff = 1;
+                break;
+            }
+            if (d > 0 && (is_lms(type, pos + d) || is_lms(type, prev + d))) {
+                break;
+            }
+        }
+        if (diff) {
+            names ++;
+            prev = pos;
+        }
+        sa[n1 + pos / 2] = names - 1;
+    }
+    int32_t j = n - 1;
+    for (int32_t i = n - 1; i >= n1; i --) {
+        if (sa[i] >= 0) {
+            sa[j --] = sa[i];
+        }
+    }
+
+    /// order the LMS suffixes: recurse if some names repeat,
+    /// otherwise the names are already their ranks.
+    int32_t * s1 = sa + n - n1;
+    int32_t * sa1 = sa;
+    int status = 0;
+    if (names < n1) {
+        status = sais(s1, sa1, n1, names);
+    } else {
+        for (int32_t i = 0; i < n1; i ++) {
+            sa1[s1[i]] = i;
+        }
+    }
+
+    /// place the sorted LMS suffixes and induce the full order from them.
+    if (status == 0) {
+        bucket_bounds(t, n, k, bucket, 1);
+        j = 0;
+        for (int32_t i = 1; i < n; i ++) {
+            if (is_lms(type, i)) {
+                s1[j ++] = i;
+            }
+        }
+        for (int32_t i = 0; i < n1; i ++) {
+            sa1[i] = s1[sa1[i]];
+        }
+        for (int32_t i = n1; i < n; i ++) {
+            sa[i] = -1;
+        }
+        for (int32_t i = n1 - 1; i >= 0; i --) {
+            j = sa[i];
+            sa[i] = -1;
+            sa[-- bucket[t[j]]] = j;
+        }
+        induce(t, sa, type, n, k, bucket);
+    }
+    free(type);
+    free(bucket);
+    return (status);
+}
+
+
+/// bwt_work_size is the number of int32_t the transforms need as scratch.
+///
+size_t bwt_work_size(size_t count) {
+    return (2 * (count + 1));
+}
+
+
+/// bwt_forward computes the Burrows-Wheeler transform of a block.
+/// the bytes are shifted up by one so that 0 can be the sentinel.
+///
+int bwt_forward(const unsigned char * in, size_t count,
+                unsigned char * out, int32_t * work, size_t * primary) {
+    int32_t * t = work;
+    int32_t * sa = work + count + 1;
+    for (size_t i = 0; i < count; i ++) {
+        t[i] = (int32_t)(in[i]) + 1;
+    }
+    t[count] = 0;
+    if (sais(t, sa, (int32_t)(count + 1), 257) != 0) {
+        return (-1);
+    }
+    size_t j = 0;
+    *primary = 0;
+    for (size_t i = 0; i <= count; i ++) {
+        if (sa[i] == 0) {
+            *primary = i;
+        } else {
+            out[j ++] = in[sa[i] - 1];
+        }
+    }
+    return (0);
+}
+
+
+/// bwt_inverse undoes bwt_forward by walking the last-to-first mapping
+/// from the sentinel's suffix back to the start of the block.
+///
+int bwt_inverse(const unsigned char * in, size_t count, size_t primary,
+                unsigned char * out, int32_t * work) {
+    if (count == 0) {
+        return (0);
+    }
+    if (primary == 0 || primary > count) {
+        return (-1);
+    }
+    /// first[c] is the first row whose suffix starts with c; row 0 is
+    /// the sentinel's.
+    int32_t first[256];
+    size_t counts[256] = { 0 };
+    for (size_t i = 0; i < count; i ++) {
+        counts[in[i]] ++;
+    }
+    int32_t sum = 1;
+    for (int c = 0; c < 256; c ++) {
+        first[c] = sum;
+        sum += (int32_t)(counts[c]);
+    }
+    int32_t * lf = work;
+    for (size_t row = 0; row <= count; row ++) {
+        if (row == primary) {
+            lf[row] = 0;
+        } else {
+            unsigned char c = in[row < primary ? row : row - 1];
+            lf[row] = first[c] ++;
+        }
+    }
+    size_t row = 0;
+    for (size_t k = count; k > 0; k --) {
+        if (row == primary) {
+            return (-1);
+        }
+        out[k - 1] = in[row < primary ? row : row - 1];
+        row = (size_t)(lf[row]);
+    }
+    return (0);
+}
+
+
+/// mtf_encode replaces each byte with its position in the recent list.
+///
+void mtf_encode(const unsigned char * in, size_t count, unsigned char * out) {
+    unsigned char list[256];
+    for (int i = 0; i < 256; i ++) {
+        list[i] = (unsigned char)(i);
+    }
+    for (size_t i = 0; i < count; i ++) {
+        unsigned char c = in[i];
+        unsigned char j = 0;
+        while (list[j] != c) {
+            j ++;
+        }
+        memmove(list + 1, list, j);
+        list[0] = c;
+        out[i] = j;
+    }
+}
+
+
+/// mtf_decode undoes mtf_encode.
+///
+void mtf_decode(const unsigned char * in, size_t count, unsigned char * out) {
+    unsigned char list[256];
+    for (int i = 0; i < 256; i ++) {
+        list[i] = (unsigned char)(i);
+    }
+    for (size_t i = 0; i < count; i ++) {
+        unsigned char j = in[i];
+        unsigned char c = list[j];
+        memmove(list + 1, list, j);
+        list[0] = c;
+        out[i] = c;
+    }
+}
+
+
+/// rle_bound is the most bytes rle_encode can write.
+///
+size_t rle_bound(size_t count) {
+    return (count + count / RLE_RUN + 1);
+}
+
+
+/// rle_encode shortens runs of RLE_RUN or more equal bytes.
+///
+size_t rle_encode(const unsigned char * in, size_t count,
+                  unsigned char * out) {
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < count) {
+        unsigned char c = in[i];
+        size_t run = 1;
+        while (i + run < count && in[i + run] == c
+               && run < RLE_RUN + RLE_MAX) {
+            run ++;
+        }
+        if (run >= RLE_RUN) {
+            memset(out + pos, c, RLE_RUN);
+            pos += RLE_RUN;
+            out[pos ++] = (unsigned char)(run - RLE_RUN);
+        } else {
+            memset(out + pos, c, run);
+            pos += run;
+        }
+        i += run;
+    }
+    return (pos);
+}
+
+
+/// rle_decode undoes rle_encode.
+///
+int rle_decode(const unsigned char * in, size_t size,
+               unsigned char * out, size_t count) {
+    size_t pos = 0;
+    size_t run = 0;
+    int last = -1;
+    size_t i = 0;
+    while (i < size) {
+        unsigned char c = in[i ++];
+        if (pos >= count) {
+            return (-1);
+        }
+        out[pos ++] = c;
+        if (c == last) {
+            run ++;
+        } else {
+            run = 1;
+            last = c;
+        }
+        if (run == RLE_RUN) {
+            if (i >= size || in[i] > count - pos) {
+                return (-1);
+            }
+            memset(out + pos, c, in[i]);
+            pos += in[i ++];
+            run = 0;
+            last = -1;
+        }
+    }
+    return (pos == count ? 0 : -1);
+}
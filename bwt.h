@@ -0,0 +1,85 @@
+/// file: bwt.h
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// the optional preprocessing stage: a Burrows-Wheeler transform built
+/// from a linear-time (SA-IS) suffix array, then move-to-front and
+/// run-length coding. together they turn repeated text into long runs
+/// of small values, which the frequency coders can squeeze.
+
+#ifndef BWT_H
+#define BWT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// bwt_work_size is the number of int32_t bwt_forward and bwt_inverse
+/// need as scratch space for a block of count bytes.
+/// @param count number of bytes in the block
+///
+size_t bwt_work_size( size_t count );
+
+/// bwt_forward computes the Burrows-Wheeler transform of a block.
+/// The block is treated as ending in a unique smallest sentinel, which
+/// is left out of the output; its row is returned instead.
+/// @param in the block
+/// @param count number of bytes in the block, less than 2^31
+/// @param out buffer for the count transformed bytes
+/// @param work scratch space of bwt_work_size(count) int32_t
+/// @param primary set to the row the sentinel was taken out of
+/// @return 0 on success, -1 if out of memory
+///
+int bwt_forward( const unsigned char * in, size_t count,
+                 unsigned char * out, int32_t * work, size_t * primary );
+
+/// bwt_inverse undoes bwt_forward.
+/// @param in the transformed block
+/// @param count number of bytes in the block
+/// @param primary the primary index bwt_forward returned
+/// @param out buffer for the count original bytes
+/// @param work scratch space of bwt_work_size(count) int32_t
+/// @return 0 on success, -1 if primary is out of range
+///
+int bwt_inverse( const unsigned char * in, size_t count, size_t primary,
+                 unsigned char * out, int32_t * work );
+
+/// mtf_encode replaces each byte with its position in a list of recently
+/// used bytes, then moves it to the front; repeats become zeros.
+/// @param in the bytes to code
+/// @param count number of bytes
+/// @param out buffer for count bytes (may be in)
+///
+void mtf_encode( const unsigned char * in, size_t count, unsigned char * out );
+
+/// mtf_decode undoes mtf_encode.
+/// @param in the coded bytes
+/// @param count number of bytes
+/// @param out buffer for count bytes (may be in)
+///
+void mtf_decode( const unsigned char * in, size_t count, unsigned char * out );
+
+/// rle_bound is the most bytes rle_encode can write for count bytes.
+/// @param count number of bytes to code
+///
+size_t rle_bound( size_t count );
+
+/// rle_encode shortens runs: after four equal bytes, one more byte holds
+/// how many further copies (0-255) were left out.
+/// @param in the bytes to code
+/// @param count number of bytes
+/// @param out buffer of at least rle_bound(count) bytes
+/// @return the number of bytes written to out
+///
+size_t rle_encode( const unsigned char * in, size_t count,
+                   unsigned char * out );
+
+/// rle_decode undoes rle_encode.
+/// @param in the coded bytes
+/// @param size number of coded bytes
+/// @param out buffer for the decoded bytes
+/// @param count number of bytes the input decodes to
+/// @return 0 on success, -1 if in does not decode to exactly count bytes
+///
+int rle_decode( const unsigned char * in, size_t size,
+                unsigned char * out, size_t count );
+
+#endif // BWT_H
@@ -1,5 +1,5 @@
 
-CFLAGS =	-ggdb -std=c99 -Wall -Wextra -pedantic -Werror
+CFLAGS =	-ggdb -O2 -std=c99 -Wall -Wextra -pedantic -Werror
 
-CLIBFLAGS =	-lm
+CLIBFLAGS =	-lm -pthread
 
@@ -0,0 +1,136 @@
+/// file: lines.c
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// splits blocks of text into their content and their line lengths,
+/// and puts them back together.
+
+#include <stdint.h>
+#include <string.h>
+#include "lines.h"
+
+/// put_varint writes value seven bits at a time, low bits first.
+/// returns the number of bytes written.
+static size_t put_varint(unsigned char * out, size_t value) {
+    size_t pos = 0;
+    while (value >= 0x80) {
+        out[pos ++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[pos ++] = (unsigned char)(value);
+    return (pos);
+}
+
+
+/// get_varint reads a value put_varint wrote at in[*pos], which holds
+/// size bytes. returns 0, or -1 if it runs off the end or overflows.
+static int get_varint(const unsigned char * in, size_t size, size_t * pos,
+                      size_t * value) {
+    *value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*pos >= size) {
+            return (-1);
+        }
+        unsigned char byte = in[(*pos) ++];
+        *value |= (size_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return (0);
+        }
+    }
+    return (-1);
+}
+
+
+/// put_run writes repeat lines of length bytes.
+/// returns the number of bytes written.
+static size_t put_run(unsigned char * out, size_t length, size_t repeat) {
+    if (repeat == 0) {
+        return (0);
+    }
+    if (repeat == 1) {
+        return (put_varint(out, length << 1));
+    }
+    size_t pos = put_varint(out, length << 1 | 1);
+    return (pos + put_varint(out + pos, repeat - 2));
+}
+
+
+/// lines_bound is the most bytes lines_split can write as lengths.
+/// a line's entry is never longer than the line and its newline.
+///
+size_t lines_bound(size_t count) {
+    return (count + 1);
+}
+
+
+/// lines_split takes the newlines out of a block.
+///
+size_t lines_split(const unsigned char * in, size_t count,
+                   unsigned char * content, unsigned char * lengths,
+                   size_t * content_count) {
+    size_t pos = 0;
+    size_t kept = 0;
+    size_t start = 0;
+    size_t last = 0;
+    size_t repeat = 0;
+    const unsigned char * newline;
+    while (start < count
+           && (newline = memchr(in + start, '\n', count - start)) != NULL) {
+        size_t length = (size_t)(newline - in) - start;
+        memcpy(content + kept, in + start, length);
+        kept += length;
+        start += length + 1;
+        if (repeat > 0 && length == last) {
+            repeat ++;
+        } else {
+            pos += put_run(lengths + pos, last, repeat);
+            last = length;
+            repeat = 1;
+        }
+    }
+    pos += put_run(lengths + pos, last, repeat);
+    memcpy(content + kept, in + start, count - start);
+    *content_count = kept + count - start;
+    return (pos);
+}
+
+
+/// lines_join undoes lines_split.
+///
+int lines_join(const unsigned char * content, size_t content_count,
+               const unsigned char * lengths, size_t size,
+               unsigned char * out, size_t count) {
+    size_t pos = 0;
+    size_t used = 0;
+    size_t written = 0;
+    while (pos < size) {
+        size_t value;
+        size_t repeat = 1;
+        if (get_varint(lengths, size, &pos, &value) != 0) {
+            return (-1);
+        }
+        size_t length = value >> 1;
+        if (value & 1) {
+            if (get_varint(lengths, size, &pos, &repeat) != 0
+                || repeat > SIZE_MAX - 2) {
+                return (-1);
+            }
+            repeat += 2;
+        }
+        if (length >= count - written
+            || repeat > (count - written) / (length + 1)
+            || (length > 0 && repeat > (content_count - used) / length)) {
+            return (-1);
+        }
+        for (size_t k = 0; k < repeat; k ++) {
+            memcpy(out + written, content + used, length);
+            written += length;
+            used += length;
+            out[written ++] = '\n';
+        }
+    }
+    if (count - written != content_count - used) {
+        return (-1);
+    }
+    memcpy(out + written, content + used, content_count - used);
+    return (0);
+}
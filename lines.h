@@ -0,0 +1,48 @@
+/// file: lines.h
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// the line-structured stage: a block of text is split into its bytes
+/// without the newlines and a compact list of line lengths. runs of
+/// equal lengths are stored once with a repeat count, so a block of
+/// fixed-length records costs a few bytes on top of its content.
+
+#ifndef LINES_H
+#define LINES_H
+
+#include <stddef.h>
+
+/// lines_bound is the most bytes lines_split can write as lengths for
+/// a block of count bytes.
+/// @param count number of bytes in the block
+///
+size_t lines_bound( size_t count );
+
+/// lines_split takes the newlines out of a block.
+/// Each line is written as a varint of its length times two, plus one
+/// if a varint count of further lines of the same length follows.
+/// Bytes after the last newline are left at the end of content.
+/// @param in the block
+/// @param count number of bytes in the block
+/// @param content buffer of count bytes for the block without newlines
+/// @param lengths buffer of lines_bound(count) bytes for the line lengths
+/// @param content_count set to the number of bytes written to content
+/// @return the number of bytes written to lengths
+///
+size_t lines_split( const unsigned char * in, size_t count,
+                    unsigned char * content, unsigned char * lengths,
+                    size_t * content_count );
+
+/// lines_join undoes lines_split, copying each line whole.
+/// @param content the block without newlines
+/// @param content_count number of bytes in content
+/// @param lengths the line lengths
+/// @param size number of bytes in lengths
+/// @param out buffer for the count bytes of the block
+/// @param count number of bytes the block holds
+/// @return 0 on success, -1 if the pieces do not make count bytes
+///
+int lines_join( const unsigned char * content, size_t content_count,
+                const unsigned char * lengths, size_t size,
+                unsigned char * out, size_t count );
+
+#endif // LINES_H
@@ -5,8 +5,11 @@
 /// create an application-specific, minimum-ordered heap, whose
 /// implementation is tailored to the variable-length coding application.
 
+#define _POSIX_C_SOURCE 200809L    // for fseeko and ftello
+
 #include <stdio.h>
 #include <string.h>
+#include <sys/types.h>
 #include "node_heap.h"
 
 /// NUL is the 0, or null character, in ASCII code representation.
@@ -26,7 +29,6 @@
 #define MAX_CODE 32
 
 
-
 ///int compare_node(Heap * heap, int child, int father) {
 ///    return 4;
 ///}
@@ -43,40 +45,99 @@
 /// @post  syms array is initialized and filled with histogram information.
 /// @post  syms is ordered so that all used entries are before unused.
 /// @post  unused syms array entries are initialized as unused.
+/// @return the number of distinct symbols placed in syms.
 ///
-int read_symbols(size_t maxcount, Symbol syms[]) {
+size_t read_symbols(size_t maxcount, Symbol syms[]) {
+    /// counts is indexed directly by byte value, so a pass over the input
+    /// costs one increment per byte and memory stays bounded to one chunk.
+    size_t counts[MAX_SYMS] = {0};
+    /// order records the byte values in order of first appearance.
+    unsigned char order[MAX_SYMS];
     size_t pos = 0;
-    char present;
-    int new_line = -1;    
-    while ((present = fgetc(stdin)) != EOF) {
-        /// If the current character has been seen before
-        int exists = 0;
-
-        /// Where in syms[] the character has been seen, if available.
-        int existsWhere;
-        for (size_t i = 0; i < maxcount; i ++) {
-            if (syms[i].symbol == present) {
-                exists = 1;
-                existsWhere = i;
-                break;
+    unsigned char chunk[READ_CHUNK];
+    size_t got;
+    while ((got = fread(chunk, 1, READ_CHUNK, stdin)) > 0) {
+        for (size_t i = 0; i < got; i ++) {
+            if (counts[chunk[i]] ++ == 0) {
+                order[pos] = chunk[i];
+                pos ++;
             }
-            if (syms[i].symbol == NUL) {
+        }
+    }
+    if (pos > maxcount) {
+        pos = maxcount;
+    }
+    for (size_t i = 0; i < pos; i ++) {
+        syms[i].symbol = order[i];
+        syms[i].frequency = counts[order[i]];
+        if (order[i] == '\n') {
+            syms[i].frequency --;
+        }
+    }
+    return (pos);
+}
+
+
+/// sample_symbols estimates the histogram of standard input from samples
+/// evenly spaced chunks of READ_CHUNK bytes, and gives every byte value a
+/// frequency of at least 1.
+/// @param maxcount the unsigned dimension of the syms array
+/// @param syms array of Symbol structures initialized and filled
+/// @param samples number of chunks to read
+/// @param sampled set to the number of bytes read
+/// @return the number of symbols placed in syms, or 0 if input cannot seek
+///
+size_t sample_symbols(size_t maxcount, Symbol syms[], size_t samples,
+                      size_t * sampled) {
+    size_t counts[MAX_SYMS] = {0};
+    unsigned char chunk[READ_CHUNK];
+    *sampled = 0;
+    off_t start = ftello(stdin);
+    if (start < 0 || fseeko(stdin, 0, SEEK_END) != 0) {
+        return (0);
+    }
+    off_t end = ftello(stdin);
+    if (end < start) {
+        return (0);
+    }
+    size_t total = (size_t)(end - start);
+    /// a sample that would cover the input reads all of it instead.
+    size_t stride = samples > 0 ? total / samples : 0;
+    size_t length = READ_CHUNK;
+    if (stride <= READ_CHUNK) {
+        samples = 1;
+        stride = total;
+        length = total;
+    }
+    for (size_t k = 0; k < samples; k ++) {
+        size_t want = length;
+        off_t at = start + (off_t)(k * stride + (stride - length) / 2);
+        if (fseeko(stdin, at, SEEK_SET) != 0) {
+            return (0);
+        }
+        do {
+            size_t got = fread(chunk, 1, want < READ_CHUNK ? want : READ_CHUNK,
+                               stdin);
+            if (got == 0) {
                 break;
             }
-        }
-        if (exists == 1) {
-            syms[existsWhere].frequency ++;
-        } else {
-            syms[pos].frequency = 1;
-            if (present == '\n') {
-                new_line = pos;
+            for (size_t i = 0; i < got; i ++) {
+                counts[chunk[i]] ++;
             }
-            syms[pos].symbol = present;
-            pos++;
-        }
+            *sampled += got;
+            want -= got;
+        } while (want > 0);
+    }
 
+    size_t pos = maxcount < MAX_SYMS ? maxcount : MAX_SYMS;
+    for (size_t i = 0; i < pos; i ++) {
+        size_t freq = counts[i];
+        if (*sampled > SAMPLE_LIMIT) {
+            freq = (size_t)((double)(freq) * SAMPLE_LIMIT / (double)(*sampled));
+        }
+        syms[i].symbol = (unsigned char)(i);
+        syms[i].frequency = freq > 0 ? freq : 1;
     }
-    syms[new_line].frequency --;
     return (pos);
 }
 
@@ -108,6 +169,15 @@ void heap_init(Heap * heap) {
 }
 
 
+/// heap_clear empties a heap without rewriting its nodes.
+/// heap_init sweeps several megabytes of unused entries; a heap that is
+/// filled again by heap_make does not need that.
+void heap_clear(Heap * heap) {
+    heap -> size = 0;
+    heap -> capacity = MAX_SYMS;
+}
+
+
 /// parent returns the parent value of a heap.
 /// takes an int, and returns one less cut in half.
 /// returns -1 if the value has no parent.
@@ -264,15 +334,24 @@ Node heap_remove( Heap * heap ) {
     heap -> array[0] = heap -> array[heap -> size - 1];
     Node k;
     k.frequency = 0;
-    heap -> array[heap -> size] = k;
+    k.num_valid = 0;
     heap -> size --;
+    /// the last entry moved to the top, so its old slot is now unused.
+    heap -> array[heap -> size] = k;
     size_t position = 0;
     while (position < heap-> size) {
         Node this = heap -> array[position];
         int left = childl(position);
         int right = childr(position);
-        Node left_node = heap -> array[left];
-        Node right_node = heap -> array[right];
+        /// children past the end of the heap count as unused entries.
+        Node left_node = k;
+        Node right_node = k;
+        if (left != -1 && (size_t)(left) < heap -> size) {
+            left_node = heap -> array[left];
+        }
+        if (right != -1 && (size_t)(right) < heap -> size) {
+            right_node = heap -> array[right];
+        }
         Node comparison;
         int lefty = 0;
         if (left_node.frequency < right_node.frequency && left_node.frequency != 0) {
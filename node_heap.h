@@ -26,6 +26,17 @@
 ///
 #define MAX_CODE  32
 
+/// READ_CHUNK is the number of bytes read_symbols takes per fread call,
+/// and the size of each chunk sample_symbols reads.
+///
+#define READ_CHUNK   65536
+
+/// SAMPLE_LIMIT is the most a sampled histogram may add up to. larger
+/// samples are scaled down to it, which keeps the tree built from them
+/// (floors included) shallower than MAX_CODE.
+///
+#define SAMPLE_LIMIT   (1 << 20)
+
 /// The Symbol structure stores:
 /// <ul><li>the <code>symbol</code> a byte (character),
 /// <li>its <code>codeword</code> representation, 
@@ -106,8 +117,30 @@ typedef struct Heap_S {
 /// @post  syms array is initialized and filled with histogram information.
 /// @post  syms is ordered so that all used entries are before unused.
 /// @post  unused syms array entries are initialized as unused.
+/// @return the number of distinct symbols placed in syms.
+/// <p>Input is read in fixed-size chunks and counted with size_t
+/// counters, so memory use does not grow with the input and inputs
+/// larger than 4 GB are counted exactly on 64-bit hosts.
 ///
-int read_symbols( size_t maxcount, Symbol syms[] );
+size_t read_symbols( size_t maxcount, Symbol syms[] );
+
+/// sample_symbols estimates the histogram of standard input from a
+/// number of evenly spaced chunks instead of reading all of it.
+/// Every byte value gets a frequency of at least 1, so bytes the sample
+/// missed can still be coded. Large samples are scaled down so that the
+/// tree built from them stays within MAX_CODE bits.
+/// @param maxcount the unsigned dimension of the syms array
+/// @param syms array of Symbol structures initialized and filled
+/// @param samples number of chunks to read; the whole input is read
+/// if that would cover it anyway
+/// @param sampled set to the number of bytes read
+/// @pre  standard input is a seekable file.
+/// @post  the position of standard input is unspecified.
+/// @return the number of symbols placed in syms, or 0 if standard input
+/// cannot seek.
+///
+size_t sample_symbols( size_t maxcount, Symbol syms[], size_t samples,
+                       size_t * sampled );
 
 /// heap_init initializes the heap storage with all unused Node entries.
 /// heap is a <em>pointer</em>, a reference to a heap structure.
@@ -119,6 +152,15 @@ int read_symbols( size_t maxcount, Symbol syms[] );
 ///
 void heap_init( Heap * heap );
 
+/// heap_clear empties a heap without rewriting its nodes, which
+/// heap_make and heap_add overwrite as they fill it anyway. It is the
+/// cheap way to reuse one heap for many trees.
+/// @param heap a valid pointer to a Heap structure
+/// @post  heap->size == 0.
+/// @post  heap->capacity is initialized to dimension of heap->array (q.v).
+///
+void heap_clear( Heap * heap );
+
 /// heap_make fills heap with symbols from symlist and <em>heapifies</em> it.
 /// heap is a <em>pointer</em>, a reference to an initialized heap.
 /// length is the length of the symlist.
@@ -0,0 +1,587 @@
+//
+// File: test_codec.c
+//
+// test_codec.c tests the vlc_codec, ans_codec, bwt and lines modules by coding
+// blocks of random bytes and checking they decode unchanged.
+//
+// @author gwr3294: gabe rippel
+//
+// // // // // // // // // // // // // // // // // // // // // // // //
+
+#define _DEFAULT_SOURCE    // for srandom, fseeko, dup2 and pipe
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bwt.h"
+#include "lines.h"
+#include "vlc_codec.h"
+
+/// generate_skewed fills bytes with count values drawn from an alphabet of
+/// distinct symbols, where each symbol is about twice as likely as the next.
+
+static void generate_skewed( size_t count, unsigned char bytes[],
+                             int distinct ) {
+
+    for ( size_t i = 0; i < count; ++i ) {
+        int sym = 0;
+        while ( sym < distinct - 1 && random() % 2 == 0 ) {
+            ++sym;
+        }
+        bytes[i] = (unsigned char)( 'A' + sym * 7 );
+    }
+}
+
+/// build_code makes the canonical code for bytes the way VLC does it:
+/// histogram, heap, tree, lengths.
+
+static void build_code( size_t count, const unsigned char bytes[],
+                        VlcCode * code, AnsCode * ans ) {
+
+    static Heap heap;
+    Symbol syms[MAX_SYMS];
+    uint16_t norm[MAX_SYMS];
+    unsigned char lengths[MAX_SYMS];
+    size_t seen[MAX_SYMS] = { 0 };
+    size_t n = 0;
+
+    memset( syms, 0, sizeof( syms ) );
+    for ( size_t i = 0; i < count; ++i ) {
+        if ( seen[bytes[i]]++ == 0 ) {
+            syms[n++].symbol = bytes[i];
+        }
+    }
+    for ( size_t i = 0; i < n; ++i ) {
+        syms[i].frequency = seen[syms[i].symbol];
+    }
+
+    ans_normalize( n, syms, norm );
+    assert( ans_code_init( ans, norm ) == 0 );
+
+    heap_init( &heap );
+    heap_make( &heap, n, syms );
+    Node node = vlc_tree( &heap );
+    assert( vlc_lengths( &node, lengths ) == 0 );
+    assert( vlc_code_init( code, lengths ) == 0 );
+}
+
+/// test_roundtrip codes count skewed bytes with each stream count,
+/// decodes them, and reports whether they came back unchanged.
+///
+static void test_roundtrip( size_t count, int distinct ) {
+
+    static VlcCode code;
+    static AnsCode ans;
+    unsigned char * in = malloc( count + 1 );
+    unsigned char * out = malloc( count + 1 );
+    size_t streams[] = { 1, 2, 3, 4, 8, VLC_MAX_STREAMS };
+
+    printf( "test_roundtrip( %zu, %d ): ", count, distinct );
+    generate_skewed( count, in, distinct );
+    build_code( count, in, &code, &ans );
+    printf( "longest code %u\n", code.max_length );
+
+    for ( size_t j = 0; j < sizeof( streams ) / sizeof( size_t ); ++j ) {
+        size_t bound = vlc_block_bound( count, streams[j] );
+        unsigned char * coded = malloc( bound );
+        size_t size = vlc_encode_block( &code, streams[j], in, count, coded );
+        int status = vlc_decode_block( &code, streams[j], coded, size,
+                                       out, count );
+        printf( "    %2zu streams: %s", streams[j],
+                status == 0 && memcmp( in, out, count ) == 0 ?
+                "same" : "DIFFERENT" );
+
+        // a block cut short must not decode.
+        if ( size > 4 * streams[j] + 1 ) {
+            status = vlc_decode_block( &code, streams[j], coded, size - 1,
+                                       out, count );
+            printf( ", truncated %s", status != 0 ? "rejected" : "ACCEPTED" );
+        }
+        printf( "\n" );
+        free( coded );
+    }
+
+    unsigned char * coded = malloc( ans_block_bound( count ) );
+    size_t size = ans_encode_block( &ans, in, count, coded );
+    int status = ans_decode_block( &ans, coded, size, out, count );
+    printf( "    ANS %zu bytes: %s", size,
+            status == 0 && memcmp( in, out, count ) == 0 ?
+            "same" : "DIFFERENT" );
+    if ( count > 0 ) {
+        // a damaged start state sends the decoder somewhere other than
+        // the state the encoder began from.
+        coded[0] ^= 0x01;
+        status = ans_decode_block( &ans, coded, size, out, count );
+        printf( ", damaged %s", status != 0 ? "rejected" : "accepted" );
+    }
+    printf( "\n" );
+    free( coded );
+    free( in );
+    free( out );
+}
+
+/// test_transform runs count skewed bytes, repeated in runs of up to
+/// repeat, through each stage of the BWT stage and then through a
+/// transformed frame, and reports whether they came back unchanged.
+///
+static void test_transform( size_t count, int distinct, size_t repeat ) {
+
+    static VlcCoder coder;
+    static Heap heap;
+    VlcWork work;
+    VlcStats stats;
+    unsigned char * in = malloc( count + 1 );
+    unsigned char * mid = malloc( count + 1 );
+    unsigned char * out = malloc( count + 1 );
+    unsigned char * runs = malloc( rle_bound( count ) );
+    int32_t * index = malloc( bwt_work_size( count ) * sizeof( int32_t ) );
+    size_t primary = 0;
+
+    printf( "test_transform( %zu, %d, %zu ):\n", count, distinct, repeat );
+    generate_skewed( count, in, distinct );
+    for ( size_t i = 1; i < count; ++i ) {
+        if ( (size_t)random() % repeat != 0 ) {
+            in[i] = in[i - 1];
+        }
+    }
+
+    assert( bwt_forward( in, count, mid, index, &primary ) == 0 );
+    int status = bwt_inverse( mid, count, primary, out, index );
+    printf( "    BWT: %s\n", status == 0 && memcmp( in, out, count ) == 0 ?
+            "same" : "DIFFERENT" );
+
+    mtf_encode( in, count, mid );
+    mtf_decode( mid, count, out );
+    printf( "    MTF: %s\n", memcmp( in, out, count ) == 0 ?
+            "same" : "DIFFERENT" );
+
+    size_t size = rle_encode( in, count, runs );
+    status = rle_decode( runs, size, out, count );
+    printf( "    RLE %zu bytes: %s", size,
+            status == 0 && memcmp( in, out, count ) == 0 ?
+            "same" : "DIFFERENT" );
+    if ( count > 0 ) {
+        status = rle_decode( runs, size, out, count - 1 );
+        printf( ", short %s", status != 0 ? "rejected" : "ACCEPTED" );
+    }
+    printf( "\n" );
+
+    // a transformed frame needs no histogram of its own.
+    assert( vlc_coder_init( &coder, &heap, 0, NULL, VLC_STREAMS,
+                            VLC_POLICY_SIZE ) == 0 );
+    coder.transform = 1;
+    vlc_work_init( &work );
+    memset( &stats, 0, sizeof( stats ) );
+    unsigned char * coded = malloc( vlc_frame_bound( count, VLC_STREAMS ) );
+    size = vlc_encode_frame( &coder, &work, in, count, coded, &stats );
+    status = vlc_decode_frame( &coder, &work, coded[8], coded + VLC_FRAME,
+                               size - VLC_FRAME, out, count );
+    printf( "    frame %zu bytes: %s\n", size,
+            size > 0 && status == 0 && memcmp( in, out, count ) == 0 ?
+            "same" : "DIFFERENT" );
+
+    vlc_work_free( &work );
+    free( coded );
+    free( index );
+    free( runs );
+    free( out );
+    free( mid );
+    free( in );
+}
+
+/// test_lines splits count bytes of lines that are width bytes long,
+/// or of random length up to width if width is negative, and reports
+/// how long the lengths came out and whether the lines come back.
+///
+static void test_lines( size_t count, int width ) {
+
+    unsigned char * in = malloc( count + 1 );
+    unsigned char * content = malloc( count + 1 );
+    unsigned char * lengths = malloc( lines_bound( count ) );
+    unsigned char * out = malloc( count + 1 );
+    size_t kept = 0;
+
+    printf( "test_lines( %zu, %d ): ", count, width );
+    generate_skewed( count, in, 4 );
+    size_t next = 0;
+    for ( size_t i = 0; i < count; ++i ) {
+        if ( i == next ) {
+            in[i] = '\n';
+            next += 1 + ( width < 0 ? (size_t)random() % (size_t)( -width )
+                                    : (size_t)width );
+        }
+    }
+
+    size_t size = lines_split( in, count, content, lengths, &kept );
+    int status = lines_join( content, kept, lengths, size, out, count );
+    printf( "%zu content, %zu lengths: %s", kept, size,
+            status == 0 && memcmp( in, out, count ) == 0 ?
+            "same" : "DIFFERENT" );
+    if ( count > 0 ) {
+        status = lines_join( content, kept, lengths, size, out, count - 1 );
+        printf( ", short %s", status != 0 ? "rejected" : "ACCEPTED" );
+    }
+    printf( "\n" );
+
+    free( out );
+    free( lengths );
+    free( content );
+    free( in );
+}
+
+/// count_symbols builds the histogram of count bytes as a symbol list.
+/// returns the number of distinct symbols.
+
+static size_t count_symbols( size_t count, const unsigned char bytes[],
+                             Symbol syms[] ) {
+
+    size_t seen[MAX_SYMS] = { 0 };
+    size_t n = 0;
+
+    memset( syms, 0, MAX_SYMS * sizeof( Symbol ) );
+    for ( size_t i = 0; i < count; ++i ) {
+        if ( seen[bytes[i]]++ == 0 ) {
+            syms[n++].symbol = bytes[i];
+        }
+    }
+    for ( size_t i = 0; i < n; ++i ) {
+        syms[i].frequency = seen[syms[i].symbol];
+    }
+    return n;
+}
+
+/// file_of puts size bytes in a temporary file, rewound to the start.
+
+static FILE * file_of( const unsigned char bytes[], size_t size ) {
+
+    FILE * file = tmpfile();
+    assert( file != NULL );
+    assert( fwrite( bytes, 1, size, file ) == size );
+    rewind( file );
+    return file;
+}
+
+/// contents reads all of file from the start into a malloc'd buffer.
+
+static unsigned char * contents( FILE * file, size_t * size ) {
+
+    fflush( file );
+    fseek( file, 0, SEEK_END );
+    *size = (size_t)ftell( file );
+    unsigned char * bytes = malloc( *size + 1 );
+    rewind( file );
+    assert( fread( bytes, 1, *size, file ) == *size );
+    return bytes;
+}
+
+/// test_file codes count skewed bytes through the file pipeline with 1
+/// and 3 coding threads, and reports whether both write the same file and
+/// whether it decodes unchanged with 1 and 3 threads. Then it cuts the
+/// file in half and damages the method of its last block, if it has one,
+/// both of which the decoder has to reject.
+///
+static void test_file( size_t count, int distinct, int transform ) {
+
+    static VlcCoder coder;
+    static Heap heap;
+    VlcStats stats;
+    Symbol syms[MAX_SYMS];
+    unsigned char * in = malloc( count + 1 );
+    unsigned char * coded[2];
+    size_t size[2];
+
+    printf( "test_file( %zu, %d, %d ):\n", count, distinct, transform );
+    generate_skewed( count, in, distinct );
+    size_t n = transform ? 0 : count_symbols( count, in, syms );
+    assert( vlc_coder_init( &coder, &heap, n, syms, VLC_STREAMS,
+                            VLC_POLICY_SIZE ) == 0 );
+    coder.transform = transform;
+
+    for ( int k = 0; k < 2; ++k ) {
+        FILE * source = file_of( in, count );
+        FILE * sink = tmpfile();
+        coder.threads = k == 0 ? 1 : 3;
+        memset( &stats, 0, sizeof( stats ) );
+        int status = vlc_encode_file( &coder, source, sink, &stats );
+        coded[k] = contents( sink, &size[k] );
+        printf( "    encode %zu threads: %zu bytes%s\n", coder.threads,
+                size[k], status == 0 ? "" : ", FAILED" );
+        fclose( sink );
+        fclose( source );
+    }
+    printf( "    files %s\n", size[0] == size[1]
+            && memcmp( coded[0], coded[1], size[0] ) == 0 ?
+            "same" : "DIFFERENT" );
+
+    for ( size_t threads = 1; threads <= 3; threads += 2 ) {
+        FILE * source = file_of( coded[0], size[0] );
+        FILE * sink = tmpfile();
+        size_t decoded = 0;
+        memset( &stats, 0, sizeof( stats ) );
+        int status = vlc_decode_file( source, sink, threads, &stats );
+        unsigned char * out = contents( sink, &decoded );
+        printf( "    decode %zu threads: %s\n", threads,
+                status == 0 && decoded == count
+                && memcmp( in, out, count ) == 0 ? "same" : "DIFFERENT" );
+        free( out );
+        fclose( sink );
+        fclose( source );
+    }
+
+    // walk the frames from the header to find the last block's.
+    size_t pos = vlc_header_parse( &coder, coded[0], size[0] );
+    size_t last = pos;
+    while ( pos + VLC_FRAME <= size[0] && coded[0][pos] != 0 ) {
+        last = pos;
+        pos += VLC_FRAME + ( coded[0][pos + 4] | coded[0][pos + 5] << 8
+                             | coded[0][pos + 6] << 16
+                             | (size_t)coded[0][pos + 7] << 24 );
+    }
+    for ( int damage = 0; damage < ( count > 0 ? 2 : 1 ); ++damage ) {
+        unsigned char * copy = malloc( size[0] );
+        memcpy( copy, coded[0], size[0] );
+        size_t length = size[0];
+        if ( damage ) {
+            copy[last + 8] = 0x3f;
+        } else {
+            length = size[0] / 2;
+        }
+        FILE * source = file_of( copy, length );
+        FILE * sink = tmpfile();
+        int status = vlc_decode_file( source, sink, 3, &stats );
+        printf( "    %s %s\n", damage ? "damaged" : "truncated",
+                status != 0 ? "rejected" : "ACCEPTED" );
+        fclose( sink );
+        fclose( source );
+        free( copy );
+    }
+
+    free( coded[1] );
+    free( coded[0] );
+    free( in );
+}
+
+/// test_sample points standard input at count skewed bytes, or at a pipe
+/// if count is 0, and samples it in the given number of chunks. It
+/// reports whether the whole input was read, whether every byte value got
+/// a frequency of at least 1, whether a whole read kept the exact counts,
+/// and how long the longest code built from the sample is.
+///
+static void test_sample( size_t count, size_t samples, int distinct ) {
+
+    static Heap heap;
+    Symbol syms[MAX_SYMS];
+    unsigned char lengths[MAX_SYMS];
+    size_t seen[MAX_SYMS] = { 0 };
+    unsigned char * in = malloc( count + 1 );
+    int saved = dup( STDIN_FILENO );
+    FILE * file = NULL;
+    int pipe_fd[2];
+    size_t sampled = 0;
+
+    printf( "test_sample( %zu, %zu, %d ): ", count, samples, distinct );
+    memset( syms, 0, sizeof( syms ) );
+    if ( count == 0 ) {
+        assert( pipe( pipe_fd ) == 0 );
+        dup2( pipe_fd[0], STDIN_FILENO );
+    } else {
+        generate_skewed( count, in, distinct );
+        for ( size_t i = 0; i < count; ++i ) {
+            ++seen[in[i]];
+        }
+        file = file_of( in, count );
+        dup2( fileno( file ), STDIN_FILENO );
+        fseeko( stdin, 0, SEEK_SET );
+    }
+    clearerr( stdin );
+    size_t n = sample_symbols( MAX_SYMS, syms, samples, &sampled );
+    dup2( saved, STDIN_FILENO );
+    close( saved );
+    clearerr( stdin );
+    if ( count == 0 ) {
+        close( pipe_fd[1] );
+        close( pipe_fd[0] );
+        printf( "%s\n", n == 0 ? "unseekable rejected" : "ACCEPTED" );
+        free( in );
+        return;
+    }
+    fclose( file );
+
+    int floors = n == MAX_SYMS;
+    int exact = 1;
+    size_t total = 0;
+    for ( size_t i = 0; i < n; ++i ) {
+        size_t want = seen[syms[i].symbol] > 0 ? seen[syms[i].symbol] : 1;
+        floors = floors && syms[i].frequency >= 1;
+        exact = exact && syms[i].frequency == want;
+        total += syms[i].frequency;
+    }
+    printf( "%s input, floors %s", sampled == count ? "whole" : "part of",
+            floors ? "kept" : "MISSING" );
+    if ( count < samples * READ_CHUNK ) {
+        printf( ", counts %s", sampled == count && exact ?
+                "exact" : "DIFFERENT" );
+    }
+    if ( sampled > SAMPLE_LIMIT ) {
+        printf( ", scaled %s", total <= SAMPLE_LIMIT + MAX_SYMS ?
+                "down" : "TOO LITTLE" );
+    }
+
+    heap_clear( &heap );
+    heap_make( &heap, n, syms );
+    Node node = vlc_tree( &heap );
+    int status = vlc_lengths( &node, lengths );
+    unsigned longest = 0;
+    for ( size_t i = 0; i < MAX_SYMS; ++i ) {
+        longest = lengths[i] > longest ? lengths[i] : longest;
+    }
+    printf( ", longest code %u%s\n", longest,
+            status == 0 && longest < MAX_CODE ? "" : " TOO LONG" );
+    free( in );
+}
+
+/// test_deep builds a code from distinct symbols with Fibonacci counts,
+/// whose tree is as deep as a histogram of that many symbols can make
+/// it, and reports how long the longest code is and whether a block using
+/// every symbol comes back through the variable length code.
+///
+static void test_deep( int distinct ) {
+
+    static VlcCoder coder;
+    static Heap heap;
+    VlcWork work;
+    VlcStats stats;
+    Symbol syms[MAX_SYMS];
+    size_t count = 1000;
+    unsigned char in[1000];
+    unsigned char out[1000];
+    size_t previous = 0;
+    size_t current = 1;
+
+    printf( "test_deep( %d ): ", distinct );
+    memset( syms, 0, sizeof( syms ) );
+    for ( int i = 0; i < distinct; ++i ) {
+        syms[i].symbol = (unsigned char)i;
+        syms[i].frequency = current;
+        size_t next = previous + current;
+        previous = current;
+        current = next;
+    }
+    for ( size_t i = 0; i < count; ++i ) {
+        in[i] = (unsigned char)( i < (size_t)distinct ? i
+                                 : (size_t)distinct - 1 );
+    }
+
+    int status = vlc_coder_init( &coder, &heap, (size_t)distinct, syms,
+                                 VLC_STREAMS, VLC_POLICY_VLC );
+    printf( "longest code %u%s", coder.vlc.max_length,
+            status == 0 && coder.vlc.max_length < MAX_CODE ?
+            "" : " TOO LONG" );
+    vlc_work_init( &work );
+    memset( &stats, 0, sizeof( stats ) );
+    unsigned char * coded = malloc( vlc_frame_bound( count, VLC_STREAMS ) );
+    size_t size = vlc_encode_frame( &coder, &work, in, count, coded, &stats );
+    status = vlc_decode_frame( &coder, &work, coded[8], coded + VLC_FRAME,
+                               size - VLC_FRAME, out, count );
+    printf( ", %s\n", size > 0 && status == 0
+            && memcmp( in, out, count ) == 0 ? "same" : "DIFFERENT" );
+
+    vlc_work_free( &work );
+    free( coded );
+}
+
+/// test_buffer codes count bytes of lines in memory with and without -l
+/// and -t, the way the server does, and reports whether they decode
+/// unchanged and whether a frame cut short is caught.
+///
+static void test_buffer( size_t count, int lines, int transform ) {
+
+    static VlcCoder coder;
+    static VlcCoder decoder;
+    static Heap heap;
+    VlcWork work;
+    VlcStats stats;
+    Symbol syms[MAX_SYMS];
+    unsigned char * in = malloc( count + 1 );
+    unsigned char * out = malloc( count + 1 );
+    unsigned char * coded = NULL;
+    size_t capacity = 0;
+    size_t decoded = 0;
+
+    printf( "test_buffer( %zu, %d, %d ): ", count, lines, transform );
+    generate_skewed( count, in, 6 );
+    for ( size_t i = 0; i < count; i += 1 + (size_t)random() % 60 ) {
+        in[i] = '\n';
+    }
+    size_t n = count_symbols( count, in, syms );
+
+    assert( vlc_coder_init( &coder, &heap, n, syms, VLC_STREAMS,
+                            VLC_POLICY_SIZE ) == 0 );
+    coder.lines = lines;
+    coder.transform = transform;
+    vlc_work_init( &work );
+    memset( &stats, 0, sizeof( stats ) );
+    size_t size = vlc_encode_buffer( &coder, &work, in, count, &coded,
+                                     &capacity, &stats );
+    size_t header = vlc_header_parse( &decoder, coded, size );
+    int status = header > 0
+                 && vlc_buffer_count( coded + header, size - header,
+                                      &decoded ) == 0
+                 && decoded == count
+                 && vlc_decode_buffer( &decoder, &work, coded + header,
+                                       size - header, out, count ) == 0
+                 ? 0 : -1;
+    printf( "%zu bytes: %s", size,
+            status == 0 && memcmp( in, out, count ) == 0 ?
+            "same" : "DIFFERENT" );
+    status = vlc_buffer_count( coded + header, size - header - 1, &decoded );
+    printf( ", truncated %s\n", status != 0 ? "rejected" : "ACCEPTED" );
+
+    vlc_work_free( &work );
+    free( coded );
+    free( out );
+    free( in );
+}
+
+/// main function runs a test suite on the coder module implementations.
+/// @returns 0 for no error
+
+int main( void ) {
+
+    srandom( 241 ); // seed the generator
+    test_roundtrip( 0, 2 );
+    test_roundtrip( 1, 1 );
+    test_roundtrip( 7, 3 );
+    test_roundtrip( 1000, 4 );
+    test_roundtrip( 100000, 12 );
+    test_roundtrip( 1000000, 24 );
+    test_transform( 1, 1, 1 );
+    test_transform( 1000, 4, 1 );
+    test_transform( 100000, 12, 8 );
+    test_transform( VLC_BLOCK, 24, 300 );
+    test_lines( 0, 10 );
+    test_lines( 1, 0 );
+    test_lines( 1000, 0 );
+    test_lines( 1100000, 10 );
+    test_lines( 100000, -200 );
+    test_file( 0, 2, 0 );
+    test_file( 3 * VLC_BLOCK + 1000, 12, 0 );
+    test_file( 5 * VLC_BLOCK / 2, 6, 1 );
+    test_sample( 0, 4, 0 );
+    test_sample( 100000, 4, 12 );
+    test_sample( 3 * READ_CHUNK + 1, 4, 12 );
+    test_sample( 16 * VLC_BLOCK, 4, 12 );
+    test_sample( 24 * VLC_BLOCK, 256, 40 );
+    test_deep( 20 );
+    test_deep( 40 );
+    test_deep( 90 );
+    test_buffer( 0, 0, 0 );
+    test_buffer( 5000, 0, 0 );
+    test_buffer( 5000, 1, 0 );
+    test_buffer( 5000, 0, 1 );
+    test_buffer( 1500000, 1, 1 );
+    return 0 ;
+}
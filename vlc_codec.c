@@ -0,0 +1,1389 @@
+/// file: vlc_codec.c
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// encodes and decodes blocks of bytes with the heap-built code,
+/// spreading each block over several interleaved bitstreams.
+
+#define _POSIX_C_SOURCE 200809L    // for pthreads and nanosleep
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bit_io.h"
+#include "bwt.h"
+#include "lines.h"
+#include "vlc_codec.h"
+
+/// VLC_VERSION is the format version written after "VLC" in the header.
+///
+#define VLC_VERSION 3
+
+/// reverse_bits flips the low length bits of code.
+static uint32_t reverse_bits(uint32_t code, unsigned length) {
+    uint32_t flipped = 0;
+    for (unsigned i = 0; i < length; i ++) {
+        flipped = (flipped << 1) | (code & 1);
+        code >>= 1;
+    }
+    return (flipped);
+}
+
+/// decode_slow decodes a code longer than the table one bit at a time.
+/// returns the symbol and its length, or a length of 0 if the bits
+/// match no code.
+static VlcEntry decode_slow(const VlcCode * code, uint64_t bits) {
+    VlcEntry entry = { 0, 0 };
+    unsigned value = 0;
+    unsigned first = 0;
+    unsigned index = 0;
+    for (unsigned len = 1; len <= code -> max_length; len ++) {
+        value |= (unsigned)(bits >> (len - 1)) & 1;
+        unsigned count = code -> count[len];
+        if (value - first < count) {
+            entry.symbol = code -> sorted[index + value - first];
+            entry.length = (unsigned char)(len);
+            break;
+        }
+        index += count;
+        first = (first + count) << 1;
+        value <<= 1;
+    }
+    return (entry);
+}
+
+/// decode_entry looks up the symbol at the front of bits.
+/// a length of 0 means the bits match no code.
+static inline VlcEntry decode_entry(const VlcCode * code, uint64_t bits) {
+    VlcEntry entry = code -> table[bits & ((1u << VLC_TABLE_BITS) - 1)];
+    if (entry.length == 0) {
+        entry = decode_slow(code, bits);
+    }
+    return (entry);
+}
+
+
+/// vlc_tree merges the nodes of a made heap until one node remains.
+///
+Node vlc_tree(Heap * heap) {
+    while (heap -> size > 1) {
+        Node lowest = heap_remove(heap);
+        Node sec_lowest = heap_remove(heap);
+        /// yes, it does it backwards. I know.
+        /// this is intentional & the report reverses it when it's time to print.
+        for (size_t i = 0; i < lowest.num_valid; i++) {
+            for (size_t j = 0; j < MAX_CODE; j ++) {
+                if (lowest.syms[i].codeword[j] == NUL) {
+                    lowest.syms[i].codeword[j] = '0';
+                    break;
+                }
+            }
+        }
+        for (size_t i = 0; i <  sec_lowest.num_valid; i ++) {
+            for (size_t j = 0; j < MAX_CODE; j++) {
+                if (sec_lowest.syms[i].codeword[j] == NUL) {
+                    sec_lowest.syms[i].codeword[j] = '1';
+                    break;
+                }
+            }
+        }
+
+        Node replacement;
+        replacement.frequency = lowest.frequency + sec_lowest.frequency;
+        replacement.num_valid = lowest.num_valid + sec_lowest.num_valid;
+
+        for (size_t i = 0; i < lowest.num_valid; i ++) {
+            replacement.syms[i] = lowest.syms[i];
+        }
+        for (size_t j = lowest.num_valid; j < replacement.num_valid; j++) {
+            replacement.syms[j] = sec_lowest.syms[j - lowest.num_valid];
+        }
+
+        heap_add(heap, replacement);
+    }
+    Node final_node;
+    if (heap -> size == 0) {
+        final_node.frequency = 0;
+        final_node.num_valid = 0;
+    } else {
+        final_node = heap_remove(heap);
+    }
+    return (final_node);
+}
+
+
+/// vlc_lengths reads the code length of every symbol in a final node.
+///
+int vlc_lengths(const Node * node, unsigned char lengths[]) {
+    memset(lengths, 0, MAX_SYMS);
+    for (size_t i = 0; i < node -> num_valid; i ++) {
+        const Symbol * sym = &node -> syms[i];
+        size_t len = 0;
+        while (len < MAX_CODE && sym -> codeword[len] != NUL) {
+            len ++;
+        }
+        if (len == MAX_CODE) {
+            return (-1);
+        }
+        lengths[sym -> symbol] = (unsigned char)(len);
+    }
+    /// a tree of one symbol has an empty codeword; give it one bit.
+    if (node -> num_valid == 1) {
+        lengths[node -> syms[0].symbol] = 1;
+    }
+    return (0);
+}
+
+
+/// vlc_code_init builds the canonical code and decode table for lengths.
+///
+int vlc_code_init(VlcCode * code, const unsigned char lengths[]) {
+    memset(code, 0, sizeof(*code));
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        if (lengths[s] >= MAX_CODE) {
+            return (-1);
+        }
+        code -> length[s] = lengths[s];
+        code -> count[lengths[s]] ++;
+        if (lengths[s] > code -> max_length) {
+            code -> max_length = lengths[s];
+        }
+    }
+    code -> count[0] = 0;
+
+    /// the lengths must not promise more codes than the bits allow.
+    uint64_t space = 1;
+    for (unsigned len = 1; len < MAX_CODE; len ++) {
+        space <<= 1;
+        if (code -> count[len] > space) {
+            return (-1);
+        }
+        space -= code -> count[len];
+    }
+    code -> complete = space == 0;
+
+    /// canonical codes: shorter codes first, ties broken by byte value.
+    unsigned offset[MAX_CODE + 1];
+    uint32_t next[MAX_CODE + 1];
+    offset[1] = 0;
+    next[1] = 0;
+    for (unsigned len = 1; len < MAX_CODE; len ++) {
+        offset[len + 1] = offset[len] + code -> count[len];
+        next[len + 1] = (next[len] + code -> count[len]) << 1;
+    }
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        unsigned len = lengths[s];
+        if (len == 0) {
+            continue;
+        }
+        code -> sorted[offset[len]] = (unsigned char)(s);
+        offset[len] ++;
+        code -> code[s] = reverse_bits(next[len], len);
+        next[len] ++;
+    }
+
+    /// every table slot whose low bits start with a short code decodes it.
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        unsigned len = lengths[s];
+        if (len == 0 || len > VLC_TABLE_BITS) {
+            continue;
+        }
+        for (uint32_t slot = code -> code[s]; slot < (1u << VLC_TABLE_BITS);
+             slot += 1u << len) {
+            code -> table[slot].symbol = (unsigned char)(s);
+            code -> table[slot].length = (unsigned char)(len);
+        }
+    }
+    return (0);
+}
+
+
+/// vlc_block_bound is the most bytes vlc_encode_block can write.
+///
+size_t vlc_block_bound(size_t count, size_t streams) {
+    size_t per_stream = count / streams + 1;
+    return (4 * streams + streams * (per_stream * MAX_CODE / 8 + 8));
+}
+
+
+/// vlc_encode_block codes count bytes into streams interleaved bitstreams.
+/// each stream is written at the worst case offset for its share of the
+/// block, then the streams are packed down behind the jump table.
+///
+size_t vlc_encode_block(const VlcCode * code, size_t streams,
+                        const unsigned char * in, size_t count,
+                        unsigned char * out) {
+    BitWriter w[VLC_MAX_STREAMS];
+    size_t stride = (count / streams + 1) * MAX_CODE / 8 + 8;
+    unsigned char * base = out + 4 * streams;
+    for (size_t s = 0; s < streams; s ++) {
+        w[s].out = base + s * stride;
+        w[s].pos = 0;
+        w[s].bits = 0;
+        w[s].count = 0;
+    }
+
+    size_t i = 0;
+    for (; i + streams <= count; i += streams) {
+        for (size_t s = 0; s < streams; s ++) {
+            unsigned char sym = in[i + s];
+            put_bits(&w[s], code -> code[sym], code -> length[sym]);
+        }
+    }
+    for (size_t s = 0; i + s < count; s ++) {
+        unsigned char sym = in[i + s];
+        put_bits(&w[s], code -> code[sym], code -> length[sym]);
+    }
+
+    size_t pos = 0;
+    for (size_t s = 0; s < streams; s ++) {
+        flush_bits(&w[s]);
+        put_u32(out + 4 * s, (uint32_t)(w[s].pos));
+        memmove(base + pos, w[s].out, w[s].pos);
+        pos += w[s].pos;
+    }
+    return (4 * streams + pos);
+}
+
+
+/// top_up is the fast refill: one load brings bits up to at least 56.
+/// the caller makes sure 8 bytes can be read at pos.
+static inline void top_up(const unsigned char * in, size_t * pos,
+                          uint64_t * bits, unsigned * count) {
+    *bits |= get_u64(in + *pos) << *count;
+    *pos += (63 - *count) >> 3;
+    *count |= 56;
+}
+
+/// take removes one symbol from the front of bits and returns it.
+/// the code must be complete, so every bit pattern starts with a code.
+static inline unsigned char take(const VlcCode * code, uint64_t * bits,
+                                 unsigned * count) {
+    VlcEntry entry = decode_entry(code, *bits);
+    *bits >>= entry.length;
+    *count -= entry.length;
+    return (entry.symbol);
+}
+
+/// decode_rounds decodes whole rounds of one symbol per stream while
+/// every stream is still short of its end, and returns the rounds done.
+/// a single refill covers as many rounds as 56 bits of the longest code.
+/// the readers are copied into locals that nothing else can point at.
+static inline size_t decode_rounds(const VlcCode * code, size_t streams,
+                            BitReader r[], unsigned char * out,
+                            size_t rounds) {
+    uint64_t bits[VLC_MAX_STREAMS];
+    unsigned count[VLC_MAX_STREAMS];
+    size_t pos[VLC_MAX_STREAMS];
+    for (size_t s = 0; s < streams; s ++) {
+        bits[s] = r[s].bits;
+        count[s] = r[s].count;
+        pos[s] = r[s].pos;
+    }
+    size_t depth = 56 / code -> max_length;
+    size_t round = 0;
+    while (round + depth <= rounds) {
+        int near_end = 0;
+        for (size_t s = 0; s < streams; s ++) {
+            near_end |= pos[s] + 8 > r[s].limit;
+        }
+        if (near_end) {
+            break;
+        }
+        for (size_t s = 0; s < streams; s ++) {
+            top_up(r[s].in, &pos[s], &bits[s], &count[s]);
+        }
+        for (size_t d = 0; d < depth; d ++) {
+            unsigned char * o = out + (round + d) * streams;
+            for (size_t s = 0; s < streams; s ++) {
+                o[s] = take(code, &bits[s], &count[s]);
+            }
+        }
+        round += depth;
+    }
+    for (size_t s = 0; s < streams; s ++) {
+        r[s].bits = bits[s];
+        r[s].count = count[s];
+        r[s].pos = pos[s];
+    }
+    return (round);
+}
+
+/// decode_rounds4 is decode_rounds written out for four streams, the
+/// default, so that each stream's bits stay in its own register and the
+/// four lookups of a round are in flight together.
+static size_t decode_rounds4(const VlcCode * code, BitReader r[],
+                             unsigned char * out, size_t rounds) {
+    uint64_t b0 = r[0].bits, b1 = r[1].bits, b2 = r[2].bits, b3 = r[3].bits;
+    unsigned c0 = r[0].count, c1 = r[1].count;
+    unsigned c2 = r[2].count, c3 = r[3].count;
+    size_t p0 = r[0].pos, p1 = r[1].pos, p2 = r[2].pos, p3 = r[3].pos;
+    size_t depth = 56 / code -> max_length;
+    size_t round = 0;
+    while (round + depth <= rounds
+           && p0 + 8 <= r[0].limit && p1 + 8 <= r[1].limit
+           && p2 + 8 <= r[2].limit && p3 + 8 <= r[3].limit) {
+        top_up(r[0].in, &p0, &b0, &c0);
+        top_up(r[1].in, &p1, &b1, &c1);
+        top_up(r[2].in, &p2, &b2, &c2);
+        top_up(r[3].in, &p3, &b3, &c3);
+        for (size_t d = 0; d < depth; d ++) {
+            unsigned char * o = out + (round + d) * 4;
+            o[0] = take(code, &b0, &c0);
+            o[1] = take(code, &b1, &c1);
+            o[2] = take(code, &b2, &c2);
+            o[3] = take(code, &b3, &c3);
+        }
+        round += depth;
+    }
+    r[0].bits = b0, r[1].bits = b1, r[2].bits = b2, r[3].bits = b3;
+    r[0].count = c0, r[1].count = c1, r[2].count = c2, r[3].count = c3;
+    r[0].pos = p0, r[1].pos = p1, r[2].pos = p2, r[3].pos = p3;
+    return (round);
+}
+
+
+/// vlc_decode_block undoes vlc_encode_block.
+///
+int vlc_decode_block(const VlcCode * code, size_t streams,
+                     const unsigned char * in, size_t size,
+                     unsigned char * out, size_t count) {
+    BitReader r[VLC_MAX_STREAMS];
+    if (streams == 0 || streams > VLC_MAX_STREAMS || size < 4 * streams) {
+        return (-1);
+    }
+    size_t pos = 4 * streams;
+    for (size_t s = 0; s < streams; s ++) {
+        size_t len = get_u32(in + 4 * s);
+        if (len > size - pos) {
+            return (-1);
+        }
+        r[s].in = in + pos;
+        r[s].pos = 0;
+        r[s].limit = len;
+        r[s].bits = 0;
+        r[s].count = 0;
+        pos += len;
+    }
+
+    /// one round takes a symbol from every stream. the streams don't
+    /// depend on each other, so their lookups run side by side.
+    int bad = 0;
+    size_t rounds = count / streams;
+    /// codes that leave bit patterns unused go the checked way throughout.
+    size_t done = 0;
+    if (!code -> complete) {
+        done = 0;
+    } else if (streams == 1) {
+        done = decode_rounds(code, 1, r, out, rounds);
+    } else if (streams == 4) {
+        done = decode_rounds4(code, r, out, rounds);
+    } else {
+        done = decode_rounds(code, streams, r, out, rounds);
+    }
+    size_t i = done * streams;
+    for (; i + streams <= count; i += streams) {
+        for (size_t s = 0; s < streams; s ++) {
+            refill(&r[s]);
+            VlcEntry entry = decode_entry(code, r[s].bits);
+            bad |= entry.length == 0;
+            r[s].bits >>= entry.length;
+            r[s].count -= entry.length;
+            out[i + s] = entry.symbol;
+        }
+    }
+    for (size_t s = 0; i + s < count; s ++) {
+        refill(&r[s]);
+        VlcEntry entry = decode_entry(code, r[s].bits);
+        bad |= entry.length == 0;
+        r[s].bits >>= entry.length;
+        r[s].count -= entry.length;
+        out[i + s] = entry.symbol;
+    }
+    if (bad) {
+        return (-1);
+    }
+    /// a stream that was read past its end was corrupt.
+    for (size_t s = 0; s < streams; s ++) {
+        if (r[s].pos * 8 - r[s].count > r[s].limit * 8) {
+            return (-1);
+        }
+    }
+    return (0);
+}
+
+
+/// vlc_symbols lists the bytes with counts, in byte order.
+///
+size_t vlc_symbols(const size_t counts[], int floor, Symbol syms[]) {
+    size_t length = 0;
+    memset(syms, 0, MAX_SYMS * sizeof(Symbol));
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        if (counts[s] > 0 || floor) {
+            syms[length].symbol = (unsigned char)(s);
+            syms[length ++].frequency = counts[s] > 0 ? counts[s] : 1;
+        }
+    }
+    return (length);
+}
+
+
+/// vlc_coder_init sets up a coder from the histogram read_symbols made.
+///
+int vlc_coder_init(VlcCoder * coder, Heap * heap, size_t length,
+                   Symbol syms[], size_t streams, int policy) {
+    unsigned char lengths[MAX_SYMS];
+    uint16_t norm[MAX_SYMS];
+    if (streams == 0 || streams > VLC_MAX_STREAMS) {
+        return (-1);
+    }
+    coder -> streams = streams;
+    coder -> policy = policy;
+    coder -> lines = 0;
+    coder -> transform = 0;
+    coder -> threads = 1;
+    coder -> samples = 0;
+    ans_normalize(length, syms, norm);
+    if (ans_code_init(&coder -> ans, norm) != 0) {
+        return (-1);
+    }
+    /// a skewed enough histogram (Fibonacci counts, say) builds a tree
+    /// deeper than MAX_CODE. halving every frequency, but keeping each at
+    /// least 1, flattens it a little more each time, and once they are
+    /// all 1 the tree is 8 levels deep at most. only the variable length
+    /// code is built from the flattened counts; ANS keeps the exact ones.
+    Symbol flattened[MAX_SYMS];
+    if (length > 0) {
+        memcpy(flattened, syms, length * sizeof(Symbol));
+    }
+    for (;;) {
+        heap_clear(heap);
+        heap_make(heap, length, flattened);
+        Node final_node = vlc_tree(heap);
+        if (vlc_lengths(&final_node, lengths) == 0) {
+            break;
+        }
+        for (size_t i = 0; i < length; i ++) {
+            size_t half = flattened[i].frequency / 2;
+            flattened[i].frequency = half > 0 ? half : 1;
+        }
+    }
+    if (vlc_code_init(&coder -> vlc, lengths) != 0) {
+        return (-1);
+    }
+    return (0);
+}
+
+
+/// tables_write stores the code lengths, then the ANS frequencies,
+/// one for each byte that has a code, since only those bytes can have
+/// a frequency.
+static size_t tables_write(const VlcCoder * coder, unsigned char * out) {
+    size_t pos = 0;
+    memcpy(out, coder -> vlc.length, MAX_SYMS);
+    pos += MAX_SYMS;
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        if (coder -> vlc.length[s] != 0) {
+            out[pos ++] = (unsigned char)(coder -> ans.norm[s]);
+            out[pos ++] = (unsigned char)(coder -> ans.norm[s] >> 8);
+        }
+    }
+    return (pos);
+}
+
+
+/// tables_size is how many bytes tables_write stored, worked out from
+/// the code lengths at the front of in.
+static size_t tables_size(const unsigned char * in) {
+    size_t size = MAX_SYMS;
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        size += in[s] != 0 ? 2 : 0;
+    }
+    return (size);
+}
+
+
+/// tables_read rebuilds both codes from the tables at the front of in,
+/// which holds size bytes. returns the bytes used, or 0 if they are bad.
+static size_t tables_read(VlcCoder * coder, const unsigned char * in,
+                          size_t size) {
+    uint16_t norm[MAX_SYMS] = { 0 };
+    if (size < MAX_SYMS || size < tables_size(in)
+        || vlc_code_init(&coder -> vlc, in) != 0) {
+        return (0);
+    }
+    size_t pos = MAX_SYMS;
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        if (coder -> vlc.length[s] != 0) {
+            norm[s] = (uint16_t)(in[pos] | in[pos + 1] << 8);
+            pos += 2;
+        }
+    }
+    if (ans_code_init(&coder -> ans, norm) != 0) {
+        return (0);
+    }
+    return (pos);
+}
+
+
+/// vlc_header_write stores the header that describes coder.
+///
+size_t vlc_header_write(const VlcCoder * coder, unsigned char * out) {
+    size_t pos = 0;
+    out[pos ++] = 'V';
+    out[pos ++] = 'L';
+    out[pos ++] = 'C';
+    out[pos ++] = VLC_VERSION;
+    out[pos ++] = (unsigned char)(coder -> streams);
+    return (pos + tables_write(coder, out + pos));
+}
+
+
+/// vlc_header_parse rebuilds the coder described by the header at the
+/// front of a buffer.
+///
+size_t vlc_header_parse(VlcCoder * coder, const unsigned char * in,
+                        size_t size) {
+    if (size < VLC_HEADER || memcmp(in, "VLC", 3) != 0
+        || in[3] != VLC_VERSION) {
+        return (0);
+    }
+    coder -> streams = in[4];
+    coder -> policy = VLC_POLICY_SIZE;
+    coder -> lines = 0;
+    coder -> transform = 0;
+    coder -> threads = 1;
+    coder -> samples = 0;
+    if (coder -> streams == 0 || coder -> streams > VLC_MAX_STREAMS) {
+        return (0);
+    }
+    size_t used = tables_read(coder, in + 5, size - 5);
+    return (used == 0 ? 0 : 5 + used);
+}
+
+
+/// vlc_header_read rebuilds the coder described by the header at the
+/// front of in.
+///
+int vlc_header_read(VlcCoder * coder, FILE * in) {
+    unsigned char header[VLC_HEADER_MAX];
+    if (fread(header, 1, VLC_HEADER, in) != VLC_HEADER) {
+        return (-1);
+    }
+    size_t rest = tables_size(header + 5) - MAX_SYMS;
+    if (fread(header + VLC_HEADER, 1, rest, in) != rest
+        || vlc_header_parse(coder, header, VLC_HEADER + rest) == 0) {
+        return (-1);
+    }
+    return (0);
+}
+
+
+/// vlc_coder_cost works out both sizes from the histogram and keeps the
+/// one the policy picks.
+///
+double vlc_coder_cost(const VlcCoder * coder, const size_t counts[],
+                      int * method) {
+    double vlc_bits = 32.0 * coder -> streams;
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        vlc_bits += (double)(counts[s]) * coder -> vlc.length[s];
+    }
+    double ans_bits = ans_cost(&coder -> ans, counts);
+    if (coder -> policy == VLC_POLICY_VLC) {
+        *method = VLC_METHOD_VLC;
+    } else if (coder -> policy == VLC_POLICY_ANS) {
+        *method = VLC_METHOD_ANS;
+    } else if (coder -> policy == VLC_POLICY_SPEED) {
+        /// the interleaved streams decode faster, so ANS has to earn it.
+        *method = ans_bits < vlc_bits * VLC_SPEED_MARGIN ?
+                  VLC_METHOD_ANS : VLC_METHOD_VLC;
+    } else {
+        *method = ans_bits < vlc_bits ? VLC_METHOD_ANS : VLC_METHOD_VLC;
+    }
+    return (*method == VLC_METHOD_ANS ? ans_bits : vlc_bits);
+}
+
+
+/// choose_method picks the backend for a block under the coder's policy.
+/// both sizes are worked out from the block's histogram rather than by
+/// coding the block twice.
+static int choose_method(const VlcCoder * coder, const unsigned char * block,
+                         size_t count) {
+    if (coder -> policy == VLC_POLICY_VLC) {
+        return (VLC_METHOD_VLC);
+    }
+    if (coder -> policy == VLC_POLICY_ANS) {
+        return (VLC_METHOD_ANS);
+    }
+    size_t counts[MAX_SYMS] = { 0 };
+    for (size_t i = 0; i < count; i ++) {
+        counts[block[i]] ++;
+    }
+    int method;
+    vlc_coder_cost(coder, counts, &method);
+    return (method);
+}
+
+
+/// vlc_work_init readies scratch space for coding blocks.
+///
+void vlc_work_init(VlcWork * work) {
+    work -> heap = NULL;
+    work -> local = NULL;
+    work -> bytes = NULL;
+    work -> runs = NULL;
+    work -> index = NULL;
+    work -> content = NULL;
+    work -> lengths = NULL;
+}
+
+
+/// vlc_work_free releases the scratch space.
+///
+void vlc_work_free(VlcWork * work) {
+    free(work -> heap);
+    free(work -> local);
+    free(work -> bytes);
+    free(work -> runs);
+    free(work -> index);
+    free(work -> content);
+    free(work -> lengths);
+    vlc_work_init(work);
+}
+
+
+/// work_ready allocates the line and transform buffers the first time
+/// they are needed. returns 0, or -1 if out of memory.
+static int work_ready(VlcWork * work) {
+    if (work -> index != NULL) {
+        return (0);
+    }
+    work -> heap = malloc(sizeof(Heap));
+    work -> local = malloc(sizeof(VlcCoder));
+    work -> bytes = malloc(VLC_BLOCK);
+    work -> runs = malloc(rle_bound(VLC_BLOCK));
+    work -> index = malloc(bwt_work_size(VLC_BLOCK) * sizeof(int32_t));
+    work -> content = malloc(VLC_BLOCK);
+    work -> lengths = malloc(lines_bound(VLC_BLOCK));
+    if (work -> heap == NULL || work -> local == NULL || work -> bytes == NULL
+        || work -> runs == NULL || work -> index == NULL
+        || work -> content == NULL || work -> lengths == NULL) {
+        vlc_work_free(work);
+        return (-1);
+    }
+    return (0);
+}
+
+
+/// vlc_frame_bound is the most bytes vlc_encode_frame can write.
+/// a transformed block may grow a little in the run-length stage and
+/// carries its own tables; a block split into lines carries its lengths.
+///
+size_t vlc_frame_bound(size_t count, size_t streams) {
+    size_t runs = rle_bound(count);
+    size_t vlc = vlc_block_bound(runs, streams);
+    size_t ans = ans_block_bound(runs);
+    return (VLC_FRAME + 8 + lines_bound(count) + 8 + VLC_TABLES_MAX
+            + (vlc > ans ? vlc : ans));
+}
+
+
+/// encode_payload codes count bytes with the backend the policy picks
+/// and reports which one in method. returns the bytes written, or 0.
+static size_t encode_payload(const VlcCoder * coder, const unsigned char * in,
+                             size_t count, unsigned char * out, int * method,
+                             VlcStats * stats) {
+    for (size_t i = 0; i < count; i ++) {
+        if (coder -> vlc.length[in[i]] == 0) {
+            /// the input changed since its histogram was taken.
+            return (0);
+        }
+    }
+    /// an empty block (a block of bare newlines, say) may come with an
+    /// empty code, which only the VLC streams can write.
+    *method = count > 0 ? choose_method(coder, in, count) : VLC_METHOD_VLC;
+    if (*method == VLC_METHOD_ANS) {
+        stats -> ans_blocks ++;
+        return (ans_encode_block(&coder -> ans, in, count, out));
+    }
+    stats -> vlc_blocks ++;
+    return (vlc_encode_block(&coder -> vlc, coder -> streams, in, count, out));
+}
+
+
+/// encode_transformed runs a block through the BWT, move-to-front and
+/// run-length stages, then codes what is left with tables built from
+/// its own histogram. the payload is the primary index, the run-length
+/// coded size, the tables and the coded bytes.
+static size_t encode_transformed(const VlcCoder * coder, VlcWork * work,
+                                 const unsigned char * block, size_t count,
+                                 unsigned char * out, int * method,
+                                 VlcStats * stats) {
+    size_t primary = 0;
+    if (count > VLC_BLOCK || work_ready(work) != 0
+        || bwt_forward(block, count, work -> bytes, work -> index,
+                       &primary) != 0) {
+        return (0);
+    }
+    mtf_encode(work -> bytes, count, work -> bytes);
+    size_t runs = rle_encode(work -> bytes, count, work -> runs);
+
+    size_t counts[MAX_SYMS] = { 0 };
+    for (size_t i = 0; i < runs; i ++) {
+        counts[work -> runs[i]] ++;
+    }
+    Symbol syms[MAX_SYMS];
+    size_t length = vlc_symbols(counts, 0, syms);
+    if (vlc_coder_init(work -> local, work -> heap, length, syms,
+                       coder -> streams, coder -> policy) != 0) {
+        return (0);
+    }
+
+    put_u32(out, (uint32_t)(primary));
+    put_u32(out + 4, (uint32_t)(runs));
+    size_t pos = 8 + tables_write(work -> local, out + 8);
+    size_t size = encode_payload(work -> local, work -> runs, runs,
+                                 out + pos, method, stats);
+    if (size == 0) {
+        return (0);
+    }
+    *method |= VLC_METHOD_BWT;
+    stats -> bwt_blocks ++;
+    return (pos + size);
+}
+
+
+/// vlc_encode_frame codes one block with the backend the policy picks.
+/// with lines split, the payload starts with the content size and the
+/// line lengths, and the content is coded after them.
+///
+size_t vlc_encode_frame(const VlcCoder * coder, VlcWork * work,
+                        const unsigned char * block, size_t count,
+                        unsigned char * out, VlcStats * stats) {
+    int method = VLC_METHOD_VLC;
+    unsigned char * payload = out + VLC_FRAME;
+    size_t total = count;
+    size_t pos = 0;
+    if (coder -> samples > 0) {
+        for (size_t i = 0; i < count; i ++) {
+            stats -> counts[block[i]] ++;
+        }
+    }
+    if (coder -> lines) {
+        size_t content = 0;
+        if (work_ready(work) != 0) {
+            return (0);
+        }
+        size_t lengths = lines_split(block, count, work -> content,
+                                     work -> lengths, &content);
+        put_u32(payload, (uint32_t)(content));
+        put_u32(payload + 4, (uint32_t)(lengths));
+        memcpy(payload + 8, work -> lengths, lengths);
+        pos = 8 + lengths;
+        block = work -> content;
+        count = content;
+        stats -> line_blocks ++;
+        stats -> line_bytes += lengths;
+    }
+    size_t size;
+    if (coder -> transform) {
+        size = encode_transformed(coder, work, block, count, payload + pos,
+                                  &method, stats);
+    } else {
+        size = encode_payload(coder, block, count, payload + pos,
+                              &method, stats);
+    }
+    if (size == 0) {
+        return (0);
+    }
+    if (coder -> lines) {
+        method |= VLC_METHOD_LINES;
+    }
+    size += pos;
+    put_u32(out, (uint32_t)(total));
+    put_u32(out + 4, (uint32_t)(size));
+    out[8] = (unsigned char)(method);
+    stats -> bytes_in += total;
+    stats -> bytes_out += VLC_FRAME + size;
+    return (VLC_FRAME + size);
+}
+
+
+/// decode_payload decodes count bytes coded by encode_payload.
+static int decode_payload(const VlcCoder * coder, int method,
+                          const unsigned char * in, size_t size,
+                          unsigned char * out, size_t count) {
+    if (method == VLC_METHOD_VLC) {
+        return (vlc_decode_block(&coder -> vlc, coder -> streams, in, size,
+                                 out, count));
+    }
+    if (method == VLC_METHOD_ANS && coder -> ans.symbols > 0) {
+        return (ans_decode_block(&coder -> ans, in, size, out, count));
+    }
+    return (-1);
+}
+
+
+/// decode_transformed undoes encode_transformed, one stage at a time.
+static int decode_transformed(const VlcCoder * coder, VlcWork * work,
+                              int method, const unsigned char * in,
+                              size_t size, unsigned char * out, size_t count) {
+    if (count > VLC_BLOCK || size < 8 || work_ready(work) != 0) {
+        return (-1);
+    }
+    size_t primary = get_u32(in);
+    size_t runs = get_u32(in + 4);
+    size_t used = tables_read(work -> local, in + 8, size - 8);
+    work -> local -> streams = coder -> streams;
+    if (runs > rle_bound(count) || used == 0
+        || decode_payload(work -> local, method, in + 8 + used,
+                          size - 8 - used, work -> runs, runs) != 0
+        || rle_decode(work -> runs, runs, work -> bytes, count) != 0) {
+        return (-1);
+    }
+    mtf_decode(work -> bytes, count, work -> bytes);
+    return (bwt_inverse(work -> bytes, count, primary, out, work -> index));
+}
+
+
+/// decode_content decodes a payload that may have been transformed.
+static int decode_content(const VlcCoder * coder, VlcWork * work, int method,
+                          const unsigned char * in, size_t size,
+                          unsigned char * out, size_t count) {
+    if (method & VLC_METHOD_BWT) {
+        return (decode_transformed(coder, work, method & ~VLC_METHOD_BWT,
+                                   in, size, out, count));
+    }
+    return (decode_payload(coder, method, in, size, out, count));
+}
+
+
+/// vlc_decode_frame decodes the payload of one frame.
+/// a block split into lines has its content decoded first, then the
+/// lines are copied out of it whole.
+///
+int vlc_decode_frame(const VlcCoder * coder, VlcWork * work, int method,
+                     const unsigned char * in, size_t size,
+                     unsigned char * out, size_t count) {
+    if ((method & VLC_METHOD_LINES) == 0) {
+        return (decode_content(coder, work, method, in, size, out, count));
+    }
+    if (count > VLC_BLOCK || size < 8 || work_ready(work) != 0) {
+        return (-1);
+    }
+    size_t content = get_u32(in);
+    size_t lengths = get_u32(in + 4);
+    if (content > count || lengths > size - 8
+        || decode_content(coder, work, method & ~VLC_METHOD_LINES,
+                          in + 8 + lengths, size - 8 - lengths,
+                          work -> content, content) != 0) {
+        return (-1);
+    }
+    return (lines_join(work -> content, content, in + 8, lengths,
+                       out, count));
+}
+
+
+/// add_stats adds what a job did to the file's totals.
+static void add_stats(VlcStats * total, const VlcStats * job) {
+    total -> vlc_blocks += job -> vlc_blocks;
+    total -> ans_blocks += job -> ans_blocks;
+    total -> bwt_blocks += job -> bwt_blocks;
+    total -> line_blocks += job -> line_blocks;
+    total -> line_bytes += job -> line_bytes;
+    total -> bytes_in += job -> bytes_in;
+    total -> bytes_out += job -> bytes_out;
+    for (int s = 0; s < MAX_SYMS; s ++) {
+        total -> counts[s] += job -> counts[s];
+    }
+}
+
+
+/// vlc_reserve doubles a buffer's capacity, or more if that is short.
+///
+int vlc_reserve(unsigned char ** buffer, size_t * capacity, size_t size) {
+    if (size <= *capacity) {
+        return (0);
+    }
+    size_t grown = *capacity * 2 > size ? *capacity * 2 : size;
+    unsigned char * larger = realloc(*buffer, grown);
+    if (larger == NULL) {
+        return (-1);
+    }
+    *buffer = larger;
+    *capacity = grown;
+    return (0);
+}
+
+
+/// vlc_encode_buffer codes a buffer the way vlc_encode_file codes a file,
+/// on the calling thread. out only ever has room for one more worst
+/// case frame beyond what is written.
+///
+size_t vlc_encode_buffer(const VlcCoder * coder, VlcWork * work,
+                         const unsigned char * in, size_t count,
+                         unsigned char ** out, size_t * capacity,
+                         VlcStats * stats) {
+    if (vlc_reserve(out, capacity, VLC_HEADER_MAX) != 0) {
+        return (0);
+    }
+    size_t pos = vlc_header_write(coder, *out);
+    for (size_t done = 0; done < count; ) {
+        size_t block = count - done < VLC_BLOCK ? count - done : VLC_BLOCK;
+        if (vlc_reserve(out, capacity,
+                    pos + vlc_frame_bound(block, coder -> streams)) != 0) {
+            return (0);
+        }
+        size_t size = vlc_encode_frame(coder, work, in + done, block,
+                                       *out + pos, stats);
+        if (size == 0) {
+            return (0);
+        }
+        pos += size;
+        done += block;
+    }
+    if (vlc_reserve(out, capacity, pos + VLC_FRAME) != 0) {
+        return (0);
+    }
+    memset(*out + pos, 0, VLC_FRAME);
+    return (pos + VLC_FRAME);
+}
+
+
+/// vlc_buffer_count adds up the frames that follow a header.
+///
+int vlc_buffer_count(const unsigned char * in, size_t size, size_t * count) {
+    size_t pos = 0;
+    *count = 0;
+    while (size - pos >= VLC_FRAME) {
+        size_t block = get_u32(in + pos);
+        size_t coded = get_u32(in + pos + 4);
+        pos += VLC_FRAME;
+        if (block == 0) {
+            return (pos == size ? 0 : -1);
+        }
+        if (block > VLC_BLOCK || coded > size - pos) {
+            return (-1);
+        }
+        pos += coded;
+        *count += block;
+    }
+    return (-1);
+}
+
+
+/// vlc_decode_buffer decodes the frames that follow a header, which
+/// vlc_buffer_count has checked add up to count bytes.
+///
+int vlc_decode_buffer(const VlcCoder * coder, VlcWork * work,
+                      const unsigned char * in, size_t size,
+                      unsigned char * out, size_t count) {
+    size_t pos = 0;
+    size_t done = 0;
+    while (size - pos >= VLC_FRAME) {
+        size_t block = get_u32(in + pos);
+        size_t coded = get_u32(in + pos + 4);
+        int method = in[pos + 8];
+        pos += VLC_FRAME;
+        if (block == 0) {
+            return (done == count ? 0 : -1);
+        }
+        if (block > count - done || coded > size - pos
+            || vlc_decode_frame(coder, work, method, in + pos, coded,
+                                out + done, block) != 0) {
+            return (-1);
+        }
+        pos += coded;
+        done += block;
+    }
+    return (-1);
+}
+
+
+/// VLC_DEPTH is how many buffers each coding thread cycles through:
+/// while it codes one, the reader fills the next and the writer drains
+/// the last.
+#define VLC_DEPTH   2
+
+/// VLC_SPINS is how many times a stage yields on an empty queue before
+/// it starts sleeping between looks.
+#define VLC_SPINS   64
+
+/// The Job structure is one buffer passed along the pipeline: a block,
+/// its frame, and what came of coding it. A job marked end carries
+/// nothing and tells the stage that gets it to stop.
+typedef struct Job_S {
+    unsigned char * block;
+    size_t count;
+    unsigned char * coded;
+    size_t size;
+    int method;
+    int status;
+    int end;
+    VlcStats stats;
+} Job;
+
+
+/// The Queue structure is a bounded single-producer, single-consumer
+/// ring of jobs. head is only written by the consumer and tail only by
+/// the producer, so neither needs a lock.
+typedef struct Queue_S {
+    Job * slots[VLC_DEPTH];
+    size_t head;
+    /// keeps head and tail on separate cache lines.
+    unsigned char pad[64];
+    size_t tail;
+} Queue;
+
+
+struct Pipeline_S;
+
+/// The Worker structure is one coding thread: its scratch space, its
+/// jobs, and the queues that carry them from the reader to it (full),
+/// from it to the writer (done), and back to the reader (empty).
+typedef struct Worker_S {
+    struct Pipeline_S * pipe;
+    VlcWork work;
+    Job jobs[VLC_DEPTH];
+    Queue empty;
+    Queue full;
+    Queue done;
+    size_t stalls;
+    pthread_t thread;
+    int started;
+} Worker;
+
+
+/// The Pipeline structure ties a reader thread, one or more coding
+/// threads and the writer (the calling thread) together. Blocks are
+/// dealt to the workers in turn, so the writer takes them back in order
+/// by visiting the workers in the same turn.
+typedef struct Pipeline_S {
+    const VlcCoder * coder;
+    FILE * in;
+    FILE * out;
+    size_t bound;
+    Worker * workers;
+    size_t threads;
+    int (* read)(struct Pipeline_S * pipe, Job * job);
+    void (* code)(const VlcCoder * coder, VlcWork * work, Job * job);
+    int (* write)(struct Pipeline_S * pipe, Job * job);
+    pthread_t reader;
+    int abort;
+    int failed;
+    size_t read_stalls;
+} Pipeline;
+
+
+/// queue_push adds job to the back of a queue. a queue holds every job
+/// of its worker at most, so it is never full.
+static void queue_push(Queue * queue, Job * job) {
+    size_t tail = __atomic_load_n(&queue -> tail, __ATOMIC_RELAXED);
+    queue -> slots[tail % VLC_DEPTH] = job;
+    __atomic_store_n(&queue -> tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+/// queue_pop takes the job at the front of a queue, or NULL if it is empty.
+static Job * queue_pop(Queue * queue) {
+    size_t head = __atomic_load_n(&queue -> head, __ATOMIC_RELAXED);
+    if (head == __atomic_load_n(&queue -> tail, __ATOMIC_ACQUIRE)) {
+        return (NULL);
+    }
+    Job * job = queue -> slots[head % VLC_DEPTH];
+    __atomic_store_n(&queue -> head, head + 1, __ATOMIC_RELEASE);
+    return (job);
+}
+
+
+/// queue_wait takes the job at the front of a queue, waiting for one if
+/// it is empty; each wait counts as one stall. returns NULL if the
+/// pipeline was aborted while waiting.
+static Job * queue_wait(Queue * queue, const int * abort, size_t * stalls) {
+    Job * job = queue_pop(queue);
+    if (job != NULL) {
+        return (job);
+    }
+    (*stalls) ++;
+    struct timespec pause = { 0, 100000 };
+    for (unsigned spins = 0; (job = queue_pop(queue)) == NULL; spins ++) {
+        if (__atomic_load_n(abort, __ATOMIC_ACQUIRE)) {
+            return (NULL);
+        }
+        if (spins < VLC_SPINS) {
+            sched_yield();
+        } else {
+            nanosleep(&pause, NULL);
+        }
+    }
+    return (job);
+}
+
+
+/// read_stage fills the workers' empty jobs in turn until the input runs
+/// out, then hands every worker an end job.
+static void * read_stage(void * arg) {
+    Pipeline * pipe = arg;
+    size_t turn = 0;
+    int status = 1;
+    while (status > 0) {
+        Worker * worker = &pipe -> workers[turn];
+        Job * job = queue_wait(&worker -> empty, &pipe -> abort,
+                               &pipe -> read_stalls);
+        if (job == NULL) {
+            return (NULL);
+        }
+        memset(&job -> stats, 0, sizeof(VlcStats));
+        status = pipe -> read(pipe, job);
+        job -> end = status <= 0;
+        if (status < 0) {
+            pipe -> failed = 1;
+        }
+        queue_push(&worker -> full, job);
+        turn = (turn + 1) % pipe -> threads;
+    }
+    for (size_t k = 1; k < pipe -> threads; k ++) {
+        Worker * worker = &pipe -> workers[turn];
+        Job * job = queue_wait(&worker -> empty, &pipe -> abort,
+                               &pipe -> read_stalls);
+        if (job == NULL) {
+            return (NULL);
+        }
+        job -> end = 1;
+        queue_push(&worker -> full, job);
+        turn = (turn + 1) % pipe -> threads;
+    }
+    return (NULL);
+}
+
+
+/// code_stage codes the jobs the reader hands one worker until it gets
+/// an end job, which it passes on to the writer.
+static void * code_stage(void * arg) {
+    Worker * worker = arg;
+    Pipeline * pipe = worker -> pipe;
+    for (;;) {
+        Job * job = queue_wait(&worker -> full, &pipe -> abort,
+                               &worker -> stalls);
+        if (job == NULL) {
+            return (NULL);
+        }
+        /// once pushed, the job belongs to the writer.
+        int end = job -> end;
+        if (!end) {
+            pipe -> code(pipe -> coder, &worker -> work, job);
+        }
+        queue_push(&worker -> done, job);
+        if (end) {
+            return (NULL);
+        }
+    }
+}
+
+
+/// pipeline_free stops and joins every thread, adds their stalls to
+/// stats, then releases the workers.
+static void pipeline_free(Pipeline * pipe, int reading, VlcStats * stats) {
+    __atomic_store_n(&pipe -> abort, 1, __ATOMIC_RELEASE);
+    if (reading) {
+        pthread_join(pipe -> reader, NULL);
+        stats -> read_stalls += pipe -> read_stalls;
+    }
+    for (size_t i = 0; i < pipe -> threads; i ++) {
+        Worker * worker = &pipe -> workers[i];
+        if (worker -> started) {
+            pthread_join(worker -> thread, NULL);
+            stats -> code_stalls += worker -> stalls;
+        }
+        vlc_work_free(&worker -> work);
+        for (size_t k = 0; k < VLC_DEPTH; k ++) {
+            free(worker -> jobs[k].block);
+            free(worker -> jobs[k].coded);
+        }
+    }
+    free(pipe -> workers);
+}
+
+
+/// pipeline_run starts the reader and the workers, then writes the
+/// coded blocks in order as they come back. stalls are added to stats.
+/// returns 0, or -1 on an I/O, coding or memory error.
+static int pipeline_run(Pipeline * pipe, VlcStats * stats) {
+    pipe -> workers = calloc(pipe -> threads, sizeof(Worker));
+    if (pipe -> workers == NULL) {
+        return (-1);
+    }
+    pipe -> abort = 0;
+    pipe -> failed = 0;
+    pipe -> read_stalls = 0;
+    int status = 0;
+    for (size_t i = 0; i < pipe -> threads; i ++) {
+        Worker * worker = &pipe -> workers[i];
+        worker -> pipe = pipe;
+        vlc_work_init(&worker -> work);
+        for (size_t k = 0; k < VLC_DEPTH; k ++) {
+            Job * job = &worker -> jobs[k];
+            job -> block = malloc(VLC_BLOCK);
+            job -> coded = malloc(pipe -> bound);
+            if (job -> block == NULL || job -> coded == NULL) {
+                status = -1;
+            }
+            queue_push(&worker -> empty, job);
+        }
+    }
+    for (size_t i = 0; i < pipe -> threads && status == 0; i ++) {
+        Worker * worker = &pipe -> workers[i];
+        worker -> started = pthread_create(&worker -> thread, NULL,
+                                           code_stage, worker) == 0;
+        if (!worker -> started) {
+            status = -1;
+        }
+    }
+    if (status != 0 || pthread_create(&pipe -> reader, NULL,
+                                      read_stage, pipe) != 0) {
+        pipeline_free(pipe, 0, stats);
+        return (-1);
+    }
+
+    size_t write_stalls = 0;
+    for (size_t turn = 0; ; turn = (turn + 1) % pipe -> threads) {
+        Worker * worker = &pipe -> workers[turn];
+        Job * job = queue_wait(&worker -> done, &pipe -> abort,
+                               &write_stalls);
+        if (job == NULL || job -> end) {
+            break;
+        }
+        if (job -> status != 0 || pipe -> write(pipe, job) != 0) {
+            status = -1;
+            break;
+        }
+        add_stats(stats, &job -> stats);
+        queue_push(&worker -> empty, job);
+    }
+    pipeline_free(pipe, 1, stats);
+    stats -> write_stalls += write_stalls;
+    return (pipe -> failed ? -1 : status);
+}
+
+
+/// encode_read reads the next block of the input.
+static int encode_read(Pipeline * pipe, Job * job) {
+    job -> count = fread(job -> block, 1, VLC_BLOCK, pipe -> in);
+    if (job -> count > 0) {
+        return (1);
+    }
+    return (ferror(pipe -> in) ? -1 : 0);
+}
+
+
+/// encode_job codes a job's block into its frame.
+static void encode_job(const VlcCoder * coder, VlcWork * work, Job * job) {
+    job -> size = vlc_encode_frame(coder, work, job -> block, job -> count,
+                                   job -> coded, &job -> stats);
+    job -> status = job -> size == 0 ? -1 : 0;
+}
+
+
+/// encode_write writes a job's frame.
+static int encode_write(Pipeline * pipe, Job * job) {
+    return (fwrite(job -> coded, 1, job -> size, pipe -> out) == job -> size ?
+            0 : -1);
+}
+
+
+/// vlc_encode_file codes in to out in blocks of VLC_BLOCK bytes.
+/// a reader thread, coder->threads coding threads and this thread,
+/// which writes, pass blocks along bounded queues, so reading, coding
+/// and writing overlap. a frame of zero bytes ends the file.
+///
+int vlc_encode_file(const VlcCoder * coder, FILE * in, FILE * out,
+                    VlcStats * stats) {
+    unsigned char header[VLC_HEADER_MAX];
+    size_t length = vlc_header_write(coder, header);
+    if (fwrite(header, 1, length, out) != length) {
+        return (-1);
+    }
+
+    Pipeline pipe;
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.coder = coder;
+    pipe.in = in;
+    pipe.out = out;
+    pipe.bound = vlc_frame_bound(VLC_BLOCK, coder -> streams);
+    pipe.threads = coder -> threads > 0 ? coder -> threads : 1;
+    pipe.read = encode_read;
+    pipe.code = encode_job;
+    pipe.write = encode_write;
+    if (pipeline_run(&pipe, stats) != 0) {
+        return (-1);
+    }
+    unsigned char end[VLC_FRAME] = { 0 };
+    return (fwrite(end, 1, VLC_FRAME, out) == VLC_FRAME ? 0 : -1);
+}
+
+
+/// decode_read reads the next frame of the input; a frame of zero bytes
+/// is the end.
+static int decode_read(Pipeline * pipe, Job * job) {
+    unsigned char frame[VLC_FRAME];
+    if (fread(frame, 1, VLC_FRAME, pipe -> in) != VLC_FRAME) {
+        return (-1);
+    }
+    job -> count = get_u32(frame);
+    job -> size = get_u32(frame + 4);
+    job -> method = frame[8];
+    if (job -> count == 0) {
+        return (0);
+    }
+    if (job -> count > VLC_BLOCK || job -> size > pipe -> bound
+        || fread(job -> coded, 1, job -> size, pipe -> in) != job -> size) {
+        return (-1);
+    }
+    return (1);
+}
+
+
+/// decode_job decodes a job's frame into its block.
+static void decode_job(const VlcCoder * coder, VlcWork * work, Job * job) {
+    job -> status = vlc_decode_frame(coder, work, job -> method, job -> coded,
+                                     job -> size, job -> block, job -> count);
+    job -> stats.bytes_in = VLC_FRAME + job -> size;
+    job -> stats.bytes_out = job -> count;
+}
+
+
+/// decode_write writes a job's decoded block.
+static int decode_write(Pipeline * pipe, Job * job) {
+    return (fwrite(job -> block, 1, job -> count, pipe -> out) == job -> count ?
+            0 : -1);
+}
+
+
+/// vlc_decode_file reads a file written by vlc_encode_file, through the
+/// same pipeline the encoder uses.
+///
+int vlc_decode_file(FILE * in, FILE * out, size_t threads, VlcStats * stats) {
+    VlcCoder * coder = malloc(sizeof(VlcCoder));
+    if (coder == NULL) {
+        return (-1);
+    }
+    if (vlc_header_read(coder, in) != 0) {
+        free(coder);
+        return (-1);
+    }
+
+    Pipeline pipe;
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.coder = coder;
+    pipe.in = in;
+    pipe.out = out;
+    pipe.bound = vlc_frame_bound(VLC_BLOCK, coder -> streams);
+    pipe.threads = threads > 0 ? threads : 1;
+    pipe.read = decode_read;
+    pipe.code = decode_job;
+    pipe.write = decode_write;
+    int status = pipeline_run(&pipe, stats);
+    free(coder);
+    return (status);
+}
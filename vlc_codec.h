@@ -0,0 +1,473 @@
+/// file: vlc_codec.h
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// turns the heap-built variable length code into real bitstreams.
+/// the payload of each block is split across several interleaved
+/// bitstreams so the decoder can work on all of them at once.
+
+#ifndef VLC_CODEC_H
+#define VLC_CODEC_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "ans_codec.h"
+#include "node_heap.h"
+
+/// VLC_BLOCK is the number of input bytes coded per block.
+/// a block is the unit the encoder and decoder hold in memory.
+///
+#define VLC_BLOCK   (1 << 20)
+
+/// VLC_MAX_STREAMS is the most interleaved bitstreams a block may use.
+///
+#define VLC_MAX_STREAMS   16
+
+/// VLC_STREAMS is the number of interleaved bitstreams used by default.
+///
+#define VLC_STREAMS   4
+
+/// VLC_TABLE_BITS is the number of bits the decoder looks up at once.
+/// codes longer than this fall back to a bit-by-bit canonical decode.
+///
+#define VLC_TABLE_BITS   11
+
+/// VLC_HEADER is the size in bytes of the fixed part of the file header:
+/// "VLC", a version byte, the stream count, and 256 code lengths.
+/// A 2 byte ANS frequency follows for each byte that has a code.
+///
+#define VLC_HEADER   (5 + MAX_SYMS)
+
+/// VLC_HEADER_MAX is the largest the file header can be.
+///
+#define VLC_HEADER_MAX   (5 + VLC_TABLES_MAX)
+
+/// VLC_FRAME is the size of the frame in front of each block:
+/// its byte count, its coded size, and the method that coded it.
+///
+#define VLC_FRAME   9
+
+/// Methods a block can be coded with.
+///
+#define VLC_METHOD_VLC   0
+#define VLC_METHOD_ANS   1
+
+/// VLC_METHOD_BWT is set in the method byte of a block that went through
+/// the BWT, move-to-front and run-length stage before being coded.
+/// Such a block carries its own code tables, since the transform leaves
+/// statistics that have little to do with the file's histogram.
+///
+#define VLC_METHOD_BWT   0x80
+
+/// VLC_METHOD_LINES is set in the method byte of a block whose newlines
+/// were taken out and whose line lengths are stored on their own.
+///
+#define VLC_METHOD_LINES   0x40
+
+/// VLC_TABLES_MAX is the largest the code tables of a block can be:
+/// 256 code lengths and a 2 byte ANS frequency for each byte with a code.
+///
+#define VLC_TABLES_MAX   (3 * MAX_SYMS)
+
+/// Policies for choosing each block's method:
+/// <ul><li>SIZE takes whichever method makes the block smaller,
+/// <li>SPEED keeps the faster VLC streams unless ANS is clearly smaller,
+/// <li>VLC and ANS use that method for every block.</ul>
+///
+#define VLC_POLICY_SIZE    0
+#define VLC_POLICY_SPEED   1
+#define VLC_POLICY_VLC     2
+#define VLC_POLICY_ANS     3
+
+/// VLC_SPEED_MARGIN is the fraction of the VLC size that ANS must come
+/// under for the SPEED policy to pick it.
+///
+#define VLC_SPEED_MARGIN   0.9
+
+/// The VlcEntry structure is one slot of the decode table:
+/// the <code>symbol</code> the looked-up bits start with, and the
+/// <code>length</code> of its code (0 if the code is longer than the table).
+///
+typedef struct VlcEntry_S {
+    /// symbol decoded by this slot.
+    unsigned char symbol;
+
+    /// code length of symbol, or 0 when the slow path must decode it.
+    unsigned char length;
+} VlcEntry;
+
+/// The VlcCode structure holds a canonical code built from code lengths:
+/// <ul><li><code>length</code>, the code length of each byte value,
+/// <li><code>code</code>, each codeword stored bit-reversed so it can be
+/// written least significant bit first,
+/// <li><code>complete</code>, whether the code uses every bit pattern,
+/// <li><code>table</code>, the decode lookup table, and
+/// <li><code>count</code> and <code>sorted</code>, the canonical
+/// ordering used to decode codes longer than the table.</ul>
+///
+typedef struct VlcCode_S {
+    /// code length of each byte value, 0 if the byte is not in the code.
+    unsigned char length[MAX_SYMS];
+
+    /// bit-reversed canonical codeword of each byte value.
+    uint32_t code[MAX_SYMS];
+
+    /// longest code length in use.
+    unsigned max_length;
+
+    /// 1 if every bit pattern starts with a code, which lets the decoder
+    /// skip checking each lookup.
+    int complete;
+
+    /// number of codes of each length.
+    unsigned short count[MAX_CODE + 1];
+
+    /// symbols in canonical order (by length, then by value).
+    unsigned char sorted[MAX_SYMS];
+
+    /// decode table indexed by the next VLC_TABLE_BITS bits of a stream.
+    VlcEntry table[1 << VLC_TABLE_BITS];
+} VlcCode;
+
+/// vlc_tree merges the nodes of a made heap until one node remains.
+/// Each symbol's codeword is built back to front, as in the report.
+/// @param heap pointer to a heap filled by heap_make
+/// @return the final Node holding every symbol and its reversed codeword
+/// @post  heap->size == 0.
+///
+Node vlc_tree( Heap * heap );
+
+/// vlc_lengths reads the code length of every symbol in a final node.
+/// A lone symbol is given length 1 so it can still be written.
+/// @param node the final node returned by vlc_tree
+/// @param lengths array of MAX_SYMS code lengths filled in
+/// @return 0 on success, -1 if a code reached MAX_CODE bits
+///
+int vlc_lengths( const Node * node, unsigned char lengths[] );
+
+/// vlc_code_init builds the canonical code and decode table for lengths.
+/// @param code pointer to the code structure to fill
+/// @param lengths array of MAX_SYMS code lengths
+/// @return 0 on success, -1 if the lengths do not form a prefix code
+///
+int vlc_code_init( VlcCode * code, const unsigned char lengths[] );
+
+/// vlc_block_bound is the most bytes vlc_encode_block can write.
+/// @param count number of input bytes in the block
+/// @param streams number of interleaved bitstreams
+///
+size_t vlc_block_bound( size_t count, size_t streams );
+
+/// vlc_encode_block codes count bytes into streams interleaved bitstreams.
+/// Byte i goes to stream i % streams. The output starts with a jump
+/// table of the byte length of each stream, followed by the streams.
+/// @param code the code to write with
+/// @param streams number of bitstreams, in [1, VLC_MAX_STREAMS]
+/// @param in the bytes to code; every byte must have a code
+/// @param count number of bytes in in
+/// @param out buffer of at least vlc_block_bound(count, streams) bytes
+/// @return the number of bytes written to out
+///
+size_t vlc_encode_block( const VlcCode * code, size_t streams,
+                         const unsigned char * in, size_t count,
+                         unsigned char * out );
+
+/// vlc_decode_block undoes vlc_encode_block.
+/// All streams are advanced together in one loop so their table
+/// lookups overlap instead of waiting on one another.
+/// @param code the code the block was written with
+/// @param streams number of bitstreams the block was written with
+/// @param in the encoded block
+/// @param size number of bytes in in
+/// @param out buffer for the count decoded bytes
+/// @param count number of bytes the block decodes to
+/// @return 0 on success, -1 if the block is corrupt
+///
+int vlc_decode_block( const VlcCode * code, size_t streams,
+                      const unsigned char * in, size_t size,
+                      unsigned char * out, size_t count );
+
+/// The VlcCoder structure holds everything a file is coded with:
+/// the heap-built <code>vlc</code> code, the <code>ans</code> code built
+/// from the same histogram, the number of <code>streams</code> per VLC
+/// block, the <code>policy</code> that picks each block's method,
+/// whether blocks are split into <code>lines</code> and
+/// <code>transform</code>ed first, and how many <code>threads</code>
+/// code blocks at once.
+///
+typedef struct VlcCoder_S {
+    /// canonical code from the heap-built tree.
+    VlcCode vlc;
+
+    /// tANS tables from the same histogram.
+    AnsCode ans;
+
+    /// interleaved bitstreams per VLC block.
+    size_t streams;
+
+    /// one of the VLC_POLICY values.
+    int policy;
+
+    /// 1 to code every block's line lengths apart from its content,
+    /// which then has no newlines.
+    int lines;
+
+    /// 1 to pass every block through the BWT stage before coding it.
+    int transform;
+
+    /// blocks coded at the same time, at least 1.
+    size_t threads;
+
+    /// chunks the histogram was estimated from, or 0 if it is exact.
+    /// a coder built from a sample tallies the bytes it codes, so the
+    /// exact histogram can be compared afterwards.
+    size_t samples;
+} VlcCoder;
+
+/// The VlcWork structure is the scratch space one thread needs to code
+/// or decode a block. Its buffers are only allocated the first time a
+/// block split into lines or transformed comes through.
+///
+typedef struct VlcWork_S {
+    /// heap for building a block's own code.
+    Heap * heap;
+
+    /// code tables of the block being worked on.
+    VlcCoder * local;
+
+    /// the block after the BWT and move-to-front, VLC_BLOCK bytes.
+    unsigned char * bytes;
+
+    /// the block after run-length coding.
+    unsigned char * runs;
+
+    /// suffix array and transform scratch.
+    int32_t * index;
+
+    /// the block without its newlines, VLC_BLOCK bytes.
+    unsigned char * content;
+
+    /// the block's line lengths.
+    unsigned char * lengths;
+} VlcWork;
+
+/// The VlcStats structure counts what the encoder or decoder did,
+/// including how often each stage of the pipeline had to wait.
+///
+typedef struct VlcStats_S {
+    /// blocks coded with the VLC streams.
+    size_t vlc_blocks;
+
+    /// blocks coded with ANS.
+    size_t ans_blocks;
+
+    /// blocks that went through the BWT stage first.
+    size_t bwt_blocks;
+
+    /// blocks split into lines first.
+    size_t line_blocks;
+
+    /// bytes spent on line lengths.
+    size_t line_bytes;
+
+    /// times the reader found no free buffer, waiting on coding or writing.
+    size_t read_stalls;
+
+    /// times a coding thread found no block to code, waiting on reading.
+    size_t code_stalls;
+
+    /// times the writer found no coded block, waiting on coding.
+    size_t write_stalls;
+
+    /// how often each byte value was coded, kept when the coder's
+    /// histogram was sampled.
+    size_t counts[MAX_SYMS];
+
+    /// bytes coded.
+    size_t bytes_in;
+
+    /// bytes written, not counting the file header.
+    size_t bytes_out;
+} VlcStats;
+
+/// vlc_symbols turns byte counts into the histogram vlc_coder_init
+/// takes.
+/// @param counts MAX_SYMS byte counts
+/// @param floor 1 to give every byte value a frequency of at least 1, so
+/// the code can also code bytes the counts missed
+/// @param syms array of MAX_SYMS symbols, cleared and filled
+/// @return the number of symbols placed in syms
+///
+size_t vlc_symbols( const size_t counts[], int floor, Symbol syms[] );
+
+/// vlc_coder_init builds both codes from the histogram read_symbols made.
+/// The coder is set up for one thread, no line split, no transform and
+/// an exact histogram. A histogram skewed enough to need codes of
+/// MAX_CODE bits or more has its frequencies halved until it does not,
+/// so any histogram gets a variable length code.
+/// @param coder pointer to the coder to fill
+/// @param heap scratch heap for building the tree; it is cleared, so it
+/// need not be initialized
+/// @param length number of valid entries in syms
+/// @param syms histogram filled by read_symbols
+/// @param streams number of bitstreams per VLC block
+/// @param policy one of the VLC_POLICY values
+/// @return 0 on success, -1 if streams is out of range or the ANS tables
+/// cannot be built
+///
+int vlc_coder_init( VlcCoder * coder, Heap * heap, size_t length,
+                    Symbol syms[], size_t streams, int policy );
+
+/// vlc_coder_cost estimates the bits a block with the given histogram
+/// takes, coded the way the coder's policy would pick.
+/// @param coder the coder to estimate with
+/// @param counts MAX_SYMS byte counts of the block
+/// @param method set to the VLC_METHOD value the policy picks
+/// @return the estimated size in bits
+///
+double vlc_coder_cost( const VlcCoder * coder, const size_t counts[],
+                       int * method );
+
+/// vlc_header_write stores the file header that describes coder.
+/// @param coder the coder to describe
+/// @param out buffer of at least VLC_HEADER_MAX bytes
+/// @return the number of bytes written to out
+///
+size_t vlc_header_write( const VlcCoder * coder, unsigned char * out );
+
+/// vlc_header_parse rebuilds a coder from the file header at the front
+/// of a buffer.
+/// @param coder pointer to the coder to fill
+/// @param in the encoded bytes
+/// @param size number of bytes in in
+/// @return the number of header bytes, or 0 if the header is bad or cut short
+///
+size_t vlc_header_parse( VlcCoder * coder, const unsigned char * in,
+                         size_t size );
+
+/// vlc_header_read rebuilds a coder from the file header at the front of in.
+/// @param coder pointer to the coder to fill
+/// @param in the encoded input
+/// @return 0 on success, -1 on an I/O error or a bad header
+///
+int vlc_header_read( VlcCoder * coder, FILE * in );
+
+/// vlc_work_init readies scratch space for coding blocks.
+/// @param work pointer to the scratch space to set up
+///
+void vlc_work_init( VlcWork * work );
+
+/// vlc_work_free releases everything vlc_work_init and the frame
+/// functions allocated in work.
+/// @param work pointer to the scratch space to release
+///
+void vlc_work_free( VlcWork * work );
+
+/// vlc_frame_bound is the most bytes vlc_encode_frame can write.
+/// @param count number of input bytes in the block
+/// @param streams number of interleaved bitstreams
+///
+size_t vlc_frame_bound( size_t count, size_t streams );
+
+/// vlc_encode_frame codes one block with the method the policy picks,
+/// and puts the frame in front of it.
+/// @param coder the coder to write with
+/// @param work scratch space for a transformed block
+/// @param block the bytes to code
+/// @param count number of bytes in block
+/// @param out buffer of at least vlc_frame_bound(count, streams) bytes
+/// @param stats counters updated with what was done
+/// @return the number of bytes written to out, or 0 if block holds a
+/// byte the coder has no code for or memory ran out
+///
+size_t vlc_encode_frame( const VlcCoder * coder, VlcWork * work,
+                         const unsigned char * block, size_t count,
+                         unsigned char * out, VlcStats * stats );
+
+/// vlc_decode_frame decodes the block that follows a frame.
+/// @param coder the coder the block was written with
+/// @param work scratch space for a transformed block
+/// @param method the method byte of the frame
+/// @param in the coded block
+/// @param size number of bytes in in
+/// @param out buffer for the count decoded bytes
+/// @param count number of bytes the block decodes to
+/// @return 0 on success, -1 if the block is corrupt
+///
+int vlc_decode_frame( const VlcCoder * coder, VlcWork * work, int method,
+                      const unsigned char * in, size_t size,
+                      unsigned char * out, size_t count );
+
+/// vlc_encode_file codes in to out in blocks of VLC_BLOCK bytes.
+/// The caller has built coder from a histogram of in and positioned in
+/// at the start of the data again, leaving out '\n' if coder splits
+/// lines, unless coder transforms its blocks, which then need no
+/// histogram. A reader thread, coder->threads coding threads and the
+/// calling thread, which writes, are joined by bounded queues of
+/// recycled buffers, so reading, coding and writing overlap.
+/// @param coder the coder to write with
+/// @param in the input, read once from its current position
+/// @param out the output, which receives the header and every block
+/// @param stats counters updated with what was done
+/// @return 0 on success, -1 on an I/O or coding error
+///
+int vlc_encode_file( const VlcCoder * coder, FILE * in, FILE * out,
+                     VlcStats * stats );
+
+/// vlc_reserve grows a malloc'd buffer so it holds at least size bytes.
+/// @param buffer malloc'd buffer (or NULL), replaced if it has to move
+/// @param capacity number of bytes *buffer has room for, updated
+/// @param size number of bytes needed
+/// @return 0 on success, -1 if out of memory
+///
+int vlc_reserve( unsigned char ** buffer, size_t * capacity, size_t size );
+
+/// vlc_encode_buffer codes count bytes in memory, on the calling thread,
+/// into the same header and frames vlc_encode_file writes.
+/// @param coder the coder to write with
+/// @param work scratch space for split or transformed blocks
+/// @param in the bytes to code
+/// @param count number of bytes in in
+/// @param out malloc'd output buffer (or NULL), grown as needed
+/// @param capacity number of bytes *out has room for, updated as it grows
+/// @param stats counters updated with what was done
+/// @return the number of bytes written to *out, or 0 on a coding error
+/// or if out of memory
+///
+size_t vlc_encode_buffer( const VlcCoder * coder, VlcWork * work,
+                          const unsigned char * in, size_t count,
+                          unsigned char ** out, size_t * capacity,
+                          VlcStats * stats );
+
+/// vlc_buffer_count checks the frames that follow a header in memory
+/// and adds up how many bytes they decode to.
+/// @param in the frames, after the header
+/// @param size number of bytes in in
+/// @param count set to the number of decoded bytes
+/// @return 0 on success, -1 if the frames are cut short or malformed
+///
+int vlc_buffer_count( const unsigned char * in, size_t size, size_t * count );
+
+/// vlc_decode_buffer decodes the frames that follow a header in memory.
+/// @param coder the coder vlc_header_parse rebuilt from the header
+/// @param work scratch space for split or transformed blocks
+/// @param in the frames, after the header
+/// @param size number of bytes in in
+/// @param out buffer for the decoded bytes
+/// @param count number of bytes vlc_buffer_count found
+/// @return 0 on success, -1 if the frames are corrupt
+///
+int vlc_decode_buffer( const VlcCoder * coder, VlcWork * work,
+                       const unsigned char * in, size_t size,
+                       unsigned char * out, size_t count );
+
+/// vlc_decode_file reads a file written by vlc_encode_file.
+/// @param in the encoded input
+/// @param out the output for the decoded bytes
+/// @param threads blocks decoded at once, at least 1
+/// @param stats counters updated with what was done
+/// @return 0 on success, -1 on an I/O error or corrupt input
+///
+int vlc_decode_file( FILE * in, FILE * out, size_t threads,
+                     VlcStats * stats );
+
+#endif // VLC_CODEC_H
@@ -0,0 +1,282 @@
+/// file: vlc_load.c
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// puts load on a server started with VLC -S: several clients send the
+/// same request over and over, and the latency of every request is kept
+/// so the percentiles can be reported.
+
+#define _POSIX_C_SOURCE 200809L    // for clock_gettime
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vlc_server.h"
+
+/// The Client structure is one connection's share of the load: the
+/// request it repeats, and the latency of each time it did.
+typedef struct Client_S {
+    const char * path;
+    int op;
+    int flags;
+    const unsigned char * payload;
+    size_t length;
+    size_t requests;
+    double * latency;
+    size_t errors;
+    pthread_t thread;
+} Client;
+
+
+/// now returns a monotonic time in seconds.
+static double now(void) {
+    struct timespec clock;
+    clock_gettime(CLOCK_MONOTONIC, &clock);
+    return ((double)clock.tv_sec + (double)clock.tv_nsec / 1e9);
+}
+
+
+/// run_client connects and sends its request the given number of times,
+/// timing each one from the first byte sent to the last byte received.
+static void * run_client(void * arg) {
+    Client * client = arg;
+    unsigned char * reply = NULL;
+    size_t capacity = 0;
+    size_t reply_length = 0;
+    int fd = vlc_connect(client -> path);
+
+    for (size_t i = 0; i < client -> requests; i ++) {
+        double start = now();
+        int status = fd < 0 ? -1 :
+                     vlc_call(fd, client -> op, client -> flags, 0, 0,
+                              client -> payload, client -> length,
+                              &reply, &capacity, &reply_length);
+        client -> latency[i] = now() - start;
+        if (status != VLC_STATUS_OK) {
+            client -> errors ++;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(reply);
+    return (NULL);
+}
+
+
+/// compare_double orders latencies for qsort.
+static int compare_double(const void * a, const void * b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return ((x > y) - (x < y));
+}
+
+
+/// read_file reads a whole file into a malloc'd buffer.
+/// returns the buffer, or NULL if the file cannot be read in full
+static unsigned char * read_file(const char * name, size_t * length) {
+    FILE * file = fopen(name, "rb");
+    unsigned char * buffer = NULL;
+    size_t capacity = 0;
+    *length = 0;
+    if (file == NULL) {
+        return (NULL);
+    }
+    for (;;) {
+        if (*length == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 65536;
+            unsigned char * larger = realloc(buffer, capacity);
+            if (larger == NULL) {
+                free(buffer);
+                fclose(file);
+                return (NULL);
+            }
+            buffer = larger;
+        }
+        size_t got = fread(buffer + *length, 1, capacity - *length, file);
+        if (got == 0) {
+            break;
+        }
+        *length += got;
+    }
+    if (ferror(file)) {
+        free(buffer);
+        buffer = NULL;
+    }
+    fclose(file);
+    return (buffer);
+}
+
+
+/// generate_lines makes count bytes of short log-like lines to send when
+/// no file is given.
+static unsigned char * generate_lines(size_t count) {
+    static const char * words[] = { "GET", "POST", "/index", "/api/v1",
+                                    "200", "404", "ok", "user=42" };
+    unsigned char * buffer = malloc(count + 1);
+    for (size_t i = 0; buffer != NULL && i < count; i ++) {
+        if (i % 40 == 39) {
+            buffer[i] = '\n';
+        } else {
+            const char * word = words[(i / 8) % 8];
+            size_t k = i % 8;
+            buffer[i] = k < strlen(word) ? (unsigned char)word[k] : ' ';
+        }
+    }
+    return (buffer);
+}
+
+
+/// usage prints how to run the program to stderr.
+static void usage(void) {
+    fprintf(stderr, "usage: vlc_load [-c clients] [-r requests]"
+            " [-o e|d|a|t] [-l] [-b] [-f file] socket\n");
+    fprintf(stderr, "    -c  connections at once (default 4)\n");
+    fprintf(stderr, "    -r  requests per connection (default 1000)\n");
+    fprintf(stderr, "    -o  encode, decode, analyze, or encode with"
+            " trained tables (default e)\n");
+    fprintf(stderr, "    -l  -b  ask for line splitting or the BWT stage\n");
+    fprintf(stderr, "    -f  payload to send (default 4 KB of log lines)\n");
+}
+
+
+/// main function starts the clients, waits for them, and reports the
+/// latency percentiles.
+/// returns 0 if every request succeeded
+int main(int argc, char * argv[]) {
+    size_t clients = 4;
+    size_t requests = 1000;
+    int op = 'e';
+    int flags = 0;
+    const char * file = NULL;
+    const char * path = NULL;
+
+    for (int i = 1; i < argc; i ++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            i ++;
+            if (atoi(argv[i]) < 1) {
+                usage();
+                return (EXIT_FAILURE);
+            }
+            clients = (size_t)(atoi(argv[i]));
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            i ++;
+            if (atoi(argv[i]) < 1) {
+                usage();
+                return (EXIT_FAILURE);
+            }
+            requests = (size_t)(atoi(argv[i]));
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            op = argv[++ i][0];
+        } else if (strcmp(argv[i], "-l") == 0) {
+            flags |= VLC_FLAG_LINES;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            flags |= VLC_FLAG_BWT;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            file = argv[++ i];
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            usage();
+            return (EXIT_FAILURE);
+        }
+    }
+    /// strchr finds the terminating NUL too, so -o "" is checked apart.
+    if (path == NULL || op == '\0' || strchr("edat", op) == NULL) {
+        usage();
+        return (EXIT_FAILURE);
+    }
+
+    size_t length = 4096;
+    unsigned char * payload = file != NULL ? read_file(file, &length)
+                                           : generate_lines(length);
+    if (payload == NULL && file != NULL) {
+        fprintf(stderr, "vlc_load: cannot read %s\n", file);
+        return (EXIT_FAILURE);
+    }
+    if (payload == NULL) {
+        fprintf(stderr, "vlc_load: out of memory\n");
+        return (EXIT_FAILURE);
+    }
+
+    /// decoding needs something encoded, and trained tables need training,
+    /// so set those up before the clock starts.
+    unsigned char * reply = NULL;
+    size_t capacity = 0;
+    size_t reply_length = 0;
+    int fd = vlc_connect(path);
+    if (fd < 0) {
+        fprintf(stderr, "vlc_load: cannot connect to %s\n", path);
+        return (EXIT_FAILURE);
+    }
+    if (op == 'd') {
+        if (vlc_call(fd, VLC_OP_ENCODE, flags, 0, 0, payload, length,
+                     &reply, &capacity, &reply_length) != VLC_STATUS_OK) {
+            fprintf(stderr, "vlc_load: encoding the payload failed\n");
+            return (EXIT_FAILURE);
+        }
+        free(payload);
+        payload = reply;
+        length = reply_length;
+        reply = NULL;
+        capacity = 0;
+    } else if (op == 't') {
+        if (vlc_call(fd, VLC_OP_ANALYZE, VLC_FLAG_TRAIN, 0, 0, payload,
+                     length, &reply, &capacity,
+                     &reply_length) != VLC_STATUS_OK) {
+            fprintf(stderr, "vlc_load: training failed\n");
+            return (EXIT_FAILURE);
+        }
+        op = 'e';
+        flags |= VLC_FLAG_TRAINED;
+    }
+    close(fd);
+    free(reply);
+
+    Client * pool = calloc(clients, sizeof(Client));
+    double * latency = malloc(clients * requests * sizeof(double));
+    if (pool == NULL || latency == NULL) {
+        fprintf(stderr, "vlc_load: out of memory\n");
+        return (EXIT_FAILURE);
+    }
+    double start = now();
+    for (size_t i = 0; i < clients; i ++) {
+        pool[i].path = path;
+        pool[i].op = op;
+        pool[i].flags = flags;
+        pool[i].payload = payload;
+        pool[i].length = length;
+        pool[i].requests = requests;
+        pool[i].latency = latency + i * requests;
+        if (pthread_create(&pool[i].thread, NULL, run_client,
+                             &pool[i]) != 0) {
+            run_client(&pool[i]);
+            pool[i].thread = pthread_self();
+        }
+    }
+    size_t errors = 0;
+    for (size_t i = 0; i < clients; i ++) {
+        if (!pthread_equal(pool[i].thread, pthread_self())) {
+            pthread_join(pool[i].thread, NULL);
+        }
+        errors += pool[i].errors;
+    }
+    double elapsed = now() - start;
+
+    size_t total = clients * requests;
+    qsort(latency, total, sizeof(double), compare_double);
+    printf("requests:\t%zu\nerrors:\t\t%zu\n", total, errors);
+    printf("payload:\t%zu bytes\n", length);
+    printf("throughput:\t%.0f requests/s\n", (double)total / elapsed);
+    printf("p50:\t\t%.1f us\n", latency[total / 2] * 1e6);
+    printf("p99:\t\t%.1f us\n", latency[total * 99 / 100] * 1e6);
+    printf("max:\t\t%.1f us\n", latency[total - 1] * 1e6);
+
+    free(latency);
+    free(pool);
+    free(payload);
+    return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,676 @@
+/// file: vlc_server.c
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// the coder as a Unix domain socket server. the main thread accepts
+/// connections and polls every idle one; a connection with a request
+/// waiting is handed to a pool of workers, one of which answers that one
+/// request with its own warm context and hands the connection back.
+
+#define _POSIX_C_SOURCE 200809L    // for sockets, poll and sigaction
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "bit_io.h"
+#include "vlc_codec.h"
+#include "vlc_server.h"
+
+/// VLC_BACKLOG is how many connections may wait to be accepted.
+///
+#define VLC_BACKLOG   64
+
+/// VLC_MAX_CLIENTS is how many connections the server holds open at once.
+/// more wait to be accepted until one closes.
+///
+#define VLC_MAX_CLIENTS   1024
+
+/// VLC_POLL_MS is how often the main thread looks for a shutdown.
+///
+#define VLC_POLL_MS   200
+
+/// VLC_TIMEOUT_S is how long a worker waits on a request or response that
+/// has stalled part way before it gives up on the connection.
+///
+#define VLC_TIMEOUT_S   5
+
+/// stopping is set by the signal handler to shut the server down. the
+/// workers look at it too, so it is only touched atomically.
+static volatile sig_atomic_t stopping = 0;
+
+/// on_signal asks the server to stop.
+static void on_signal(int sig) {
+    (void)(sig);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+}
+
+
+/// stopped returns 1 once a shutdown has been asked for.
+static int stopped(void) {
+    return (__atomic_load_n(&stopping, __ATOMIC_RELAXED) != 0);
+}
+
+
+/// The Context structure is everything a worker keeps warm between
+/// requests: the heap and coder that codes are built in, the coder
+/// rebuilt from the last header decoded (and that header, so the next
+/// one like it skips the rebuild), block scratch space, and the request
+/// and response buffers, which only ever grow.
+typedef struct Context_S {
+    Heap * heap;
+    VlcCoder * coder;
+    VlcCoder * decoder;
+    unsigned char header[VLC_HEADER_MAX];
+    size_t header_size;
+    VlcWork work;
+    unsigned char * in;
+    size_t in_capacity;
+    unsigned char * out;
+    size_t out_capacity;
+    size_t requests;
+    size_t cached;
+} Context;
+
+
+/// The Server structure is the pool: the queue of connections with a
+/// request waiting for a worker, the connections workers have answered
+/// and hand back to be polled (with a pipe that wakes the poller when
+/// they do), and the trained tables shared by every worker. Each open
+/// connection is in exactly one place: polled by the main thread, in
+/// the queue, with a worker, or handed back.
+typedef struct Server_S {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    int pending[VLC_MAX_CLIENTS];
+    size_t head;
+    size_t count;
+    int answered[VLC_MAX_CLIENTS];
+    size_t answered_count;
+    size_t connections;
+    int wake[2];
+    int done;
+    VlcCoder * trained;
+    int has_trained;
+} Server;
+
+
+/// The Worker structure is one thread of the pool.
+typedef struct Worker_S {
+    Server * server;
+    Context context;
+    pthread_t thread;
+    int started;
+} Worker;
+
+
+/// read_full reads exactly size bytes. returns 0, or -1 on an error or
+/// if the other end closed first.
+static int read_full(int fd, unsigned char * buffer, size_t size) {
+    while (size > 0) {
+        ssize_t got = read(fd, buffer, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return (-1);
+        }
+        buffer += got;
+        size -= (size_t)(got);
+    }
+    return (0);
+}
+
+
+/// write_full writes exactly size bytes. returns 0, or -1 on an error.
+static int write_full(int fd, const unsigned char * buffer, size_t size) {
+    while (size > 0) {
+        ssize_t put = write(fd, buffer, size);
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            return (-1);
+        }
+        buffer += put;
+        size -= (size_t)(put);
+    }
+    return (0);
+}
+
+
+/// context_init allocates a worker's context. returns 0, or -1 if out of
+/// memory.
+static int context_init(Context * context) {
+    memset(context, 0, sizeof(*context));
+    vlc_work_init(&context -> work);
+    context -> heap = malloc(sizeof(Heap));
+    context -> coder = malloc(sizeof(VlcCoder));
+    context -> decoder = malloc(sizeof(VlcCoder));
+    if (context -> heap == NULL || context -> coder == NULL
+        || context -> decoder == NULL) {
+        return (-1);
+    }
+    heap_init(context -> heap);
+    return (0);
+}
+
+
+/// context_free releases a worker's context.
+static void context_free(Context * context) {
+    vlc_work_free(&context -> work);
+    free(context -> heap);
+    free(context -> coder);
+    free(context -> decoder);
+    free(context -> in);
+    free(context -> out);
+}
+
+
+/// histogram counts the bytes of a payload into syms, leaving out '\n'
+/// when lines are split. with floor set, every byte value gets a
+/// frequency of at least 1. returns the number of symbols placed.
+static size_t histogram(const unsigned char * in, size_t count, int lines,
+                        int floor, Symbol syms[]) {
+    size_t counts[MAX_SYMS] = { 0 };
+    for (size_t i = 0; i < count; i ++) {
+        counts[in[i]] ++;
+    }
+    if (lines) {
+        counts['\n'] = 0;
+    }
+    return (vlc_symbols(counts, floor, syms));
+}
+
+
+/// do_encode answers an ENCODE request into the context's out buffer,
+/// refusing output over VLC_MAX_PAYLOAD bytes.
+/// returns the response length, or 0 with *error set.
+static size_t do_encode(Server * server, Context * context, int flags,
+                        size_t streams, int policy, size_t length,
+                        const char ** error) {
+    static Symbol empty[MAX_SYMS];
+    Symbol syms[MAX_SYMS];
+    VlcCoder * coder = context -> coder;
+    int lines = (flags & VLC_FLAG_LINES) != 0;
+    int transform = (flags & VLC_FLAG_BWT) != 0;
+    if (flags & VLC_FLAG_TRAINED) {
+        pthread_mutex_lock(&server -> lock);
+        int has = server -> has_trained;
+        if (has) {
+            memcpy(coder, server -> trained, sizeof(VlcCoder));
+        }
+        pthread_mutex_unlock(&server -> lock);
+        if (!has) {
+            *error = "no trained tables";
+            return (0);
+        }
+        /// the tables do not depend on either, so the request's own apply.
+        coder -> streams = streams;
+        coder -> policy = policy;
+    } else {
+        size_t symbols = transform ? 0 :
+                         histogram(context -> in, length, lines, 0, syms);
+        if (vlc_coder_init(coder, context -> heap, symbols,
+                           transform ? empty : syms, streams, policy) != 0) {
+            *error = "cannot build a code";
+            return (0);
+        }
+    }
+    coder -> lines = lines;
+    coder -> transform = transform;
+    VlcStats stats;
+    memset(&stats, 0, sizeof(stats));
+    size_t size = vlc_encode_buffer(coder, &context -> work, context -> in,
+                                    length, &context -> out,
+                                    &context -> out_capacity, &stats);
+    if (size == 0) {
+        *error = "encoding failed";
+    } else if (size > VLC_MAX_PAYLOAD) {
+        /// input that does not compress comes out a little larger.
+        *error = "encoded size is over the payload limit";
+        size = 0;
+    }
+    return (size);
+}
+
+
+/// do_decode answers a DECODE request into the context's out buffer.
+/// a header the same as the last one reuses the tables built from it,
+/// and input that decodes to more than VLC_MAX_PAYLOAD bytes is refused.
+/// returns the response length, or 0 with *error set.
+static size_t do_decode(Context * context, size_t length,
+                        const char ** error) {
+    const unsigned char * in = context -> in;
+    size_t header = VLC_HEADER;
+    if (length >= VLC_HEADER) {
+        for (size_t s = 0; s < MAX_SYMS; s ++) {
+            header += in[5 + s] != 0 ? 2 : 0;
+        }
+    }
+    size_t count = 0;
+    *error = "input is not a valid encoded file";
+    if (length < header) {
+        return (0);
+    }
+    if (header == context -> header_size
+        && memcmp(in, context -> header, header) == 0) {
+        context -> cached ++;
+    } else {
+        context -> header_size = 0;
+        if (vlc_header_parse(context -> decoder, in, length) != header) {
+            return (0);
+        }
+        memcpy(context -> header, in, header);
+        context -> header_size = header;
+    }
+    if (vlc_buffer_count(in + header, length - header, &count) != 0) {
+        return (0);
+    }
+    if (count > VLC_MAX_PAYLOAD) {
+        /// a small file can decode to more than a response can carry.
+        *error = "decoded size is over the payload limit";
+        return (0);
+    }
+    if (vlc_reserve(&context -> out, &context -> out_capacity, count + 1) != 0
+        || vlc_decode_buffer(context -> decoder, &context -> work,
+                             in + header, length - header,
+                             context -> out, count) != 0) {
+        return (0);
+    }
+    *error = NULL;
+    return (count);
+}
+
+
+/// do_analyze answers an ANALYZE request with the code report's summary,
+/// and keeps the code as the trained tables if asked to.
+/// returns the response length, or 0 with *error set.
+static size_t do_analyze(Server * server, Context * context, int flags,
+                         size_t streams, int policy, size_t length,
+                         const char ** error) {
+    Symbol syms[MAX_SYMS];
+    VlcCoder * coder = context -> coder;
+    size_t symbols = histogram(context -> in, length, 0, 0, syms);
+    if (vlc_coder_init(coder, context -> heap, symbols, syms,
+                       streams, policy) != 0) {
+        *error = "cannot build a code";
+        return (0);
+    }
+    double bits = 0;
+    double entropy = 0;
+    for (size_t i = 0; i < symbols; i ++) {
+        double freq = (double)(syms[i].frequency);
+        bits += freq * coder -> vlc.length[syms[i].symbol];
+        entropy -= freq * log2(freq / (double)(length));
+    }
+    if (vlc_reserve(&context -> out, &context -> out_capacity, 512) != 0) {
+        *error = "out of memory";
+        return (0);
+    }
+    int size = snprintf((char *)(context -> out), 512,
+                        "Average VLC code length:\t%.4f\n"
+                        "Entropy:\t%.4f\n"
+                        "Longest variable code length:\t%u\n"
+                        "Node cumulative frequency:\t%zu\n"
+                        "Number of distinct symbols:\t%zu\n",
+                        length > 0 ? bits / (double)(length) : 0.0,
+                        length > 0 ? entropy / (double)(length) : 0.0,
+                        coder -> vlc.max_length, length, symbols);
+
+    if (flags & VLC_FLAG_TRAIN) {
+        /// trained tables must code whatever comes later, so every byte
+        /// value gets a floor.
+        symbols = histogram(context -> in, length, 0, 1, syms);
+        if (vlc_coder_init(coder, context -> heap, symbols, syms,
+                           streams, policy) != 0) {
+            *error = "cannot build a code";
+            return (0);
+        }
+        pthread_mutex_lock(&server -> lock);
+        memcpy(server -> trained, coder, sizeof(VlcCoder));
+        server -> has_trained = 1;
+        pthread_mutex_unlock(&server -> lock);
+    }
+    return ((size_t)(size));
+}
+
+
+/// serve answers one request on a connection that has one waiting.
+/// returns 0 to keep the connection, or -1 once it should be closed.
+static int serve(Server * server, Context * context, int fd) {
+    unsigned char request[VLC_REQUEST];
+    if (read_full(fd, request, VLC_REQUEST) != 0) {
+        return (-1);
+    }
+    int op = request[0];
+    int flags = request[1];
+    size_t streams = request[2] > 0 ? request[2] : VLC_STREAMS;
+    int policy = request[3] > 0 ? request[3] - 1 : VLC_POLICY_SIZE;
+    size_t length = get_u32(request + 4);
+    if (streams > VLC_MAX_STREAMS || policy > VLC_POLICY_ANS) {
+        op = 0;
+    }
+    if (length > VLC_MAX_PAYLOAD
+        || vlc_reserve(&context -> in, &context -> in_capacity, length + 1) != 0
+        || read_full(fd, context -> in, length) != 0) {
+        return (-1);
+    }
+
+    const char * error = NULL;
+    size_t size = 0;
+    if (op == VLC_OP_ENCODE) {
+        size = do_encode(server, context, flags, streams, policy, length,
+                         &error);
+    } else if (op == VLC_OP_DECODE) {
+        size = do_decode(context, length, &error);
+    } else if (op == VLC_OP_ANALYZE) {
+        size = do_analyze(server, context, flags, streams, policy, length,
+                          &error);
+    } else {
+        error = "bad request";
+    }
+    context -> requests ++;
+
+    unsigned char response[VLC_RESPONSE];
+    const unsigned char * payload = context -> out;
+    if (error != NULL) {
+        payload = (const unsigned char *)(error);
+        size = strlen(error);
+    }
+    response[0] = error != NULL ? VLC_STATUS_ERROR : VLC_STATUS_OK;
+    put_u32(response + 1, (uint32_t)(size));
+    if (write_full(fd, response, VLC_RESPONSE) != 0
+        || write_full(fd, payload, size) != 0) {
+        return (-1);
+    }
+    return (0);
+}
+
+
+/// work_loop takes connections with a request waiting off the queue,
+/// answers the request, and hands the connection back to be polled,
+/// until the server shuts down.
+static void * work_loop(void * arg) {
+    Worker * worker = arg;
+    Server * server = worker -> server;
+    for (;;) {
+        pthread_mutex_lock(&server -> lock);
+        while (server -> count == 0 && !server -> done) {
+            pthread_cond_wait(&server -> ready, &server -> lock);
+        }
+        if (server -> count == 0) {
+            pthread_mutex_unlock(&server -> lock);
+            return (NULL);
+        }
+        int fd = server -> pending[server -> head];
+        server -> head = (server -> head + 1) % VLC_MAX_CLIENTS;
+        server -> count --;
+        pthread_mutex_unlock(&server -> lock);
+
+        int keep = serve(server, &worker -> context, fd) == 0;
+        pthread_mutex_lock(&server -> lock);
+        if (keep && !server -> done) {
+            server -> answered[server -> answered_count ++] = fd;
+        } else {
+            close(fd);
+            server -> connections --;
+        }
+        pthread_mutex_unlock(&server -> lock);
+        /// the pipe is non-blocking; if it is full, the poller is already
+        /// due to wake.
+        ssize_t ignored = write(server -> wake[1], "", 1);
+        (void)(ignored);
+    }
+}
+
+
+/// accept_client accepts a waiting connection and gives it timeouts, so
+/// a client that stalls part way through a request cannot hold a worker.
+/// returns the connection, or -1.
+static int accept_client(int listener) {
+    struct timeval timeout = { VLC_TIMEOUT_S, 0 };
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0) {
+        return (-1);
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return (fd);
+}
+
+
+/// poll_clients accepts connections and polls the idle ones, queueing
+/// each that has a request waiting, until the server is told to stop.
+/// idle holds the connections the main thread is polling.
+static void poll_clients(Server * server, int listener, int idle[]) {
+    static struct pollfd polls[2 + VLC_MAX_CLIENTS];
+    size_t idle_count = 0;
+    while (!stopped()) {
+        pthread_mutex_lock(&server -> lock);
+        while (server -> answered_count > 0) {
+            server -> answered_count --;
+            idle[idle_count ++] = server -> answered[server -> answered_count];
+        }
+        int full = server -> connections >= VLC_MAX_CLIENTS;
+        pthread_mutex_unlock(&server -> lock);
+
+        /// poll skips negative descriptors, so a full server stops
+        /// accepting without rebuilding the list.
+        polls[0].fd = server -> wake[0];
+        polls[1].fd = full ? -1 : listener;
+        for (size_t i = 0; i < idle_count; i ++) {
+            polls[2 + i].fd = idle[i];
+        }
+        for (size_t i = 0; i < 2 + idle_count; i ++) {
+            polls[i].events = POLLIN;
+            polls[i].revents = 0;
+        }
+        if (poll(polls, 2 + idle_count, VLC_POLL_MS) <= 0) {
+            continue;
+        }
+        if (polls[0].revents & POLLIN) {
+            unsigned char drain[64];
+            while (read(server -> wake[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+
+        int fd = polls[1].revents & POLLIN ? accept_client(listener) : -1;
+
+        /// a hang up counts as ready too; the worker finds it closed.
+        size_t kept = 0;
+        pthread_mutex_lock(&server -> lock);
+        for (size_t i = 0; i < idle_count; i ++) {
+            if (polls[2 + i].revents != 0) {
+                server -> pending[(server -> head + server -> count)
+                                  % VLC_MAX_CLIENTS] = idle[i];
+                server -> count ++;
+                pthread_cond_signal(&server -> ready);
+            } else {
+                idle[kept ++] = idle[i];
+            }
+        }
+        idle_count = kept;
+        if (fd >= 0) {
+            idle[idle_count ++] = fd;
+            server -> connections ++;
+        }
+        pthread_mutex_unlock(&server -> lock);
+    }
+    for (size_t i = 0; i < idle_count; i ++) {
+        close(idle[i]);
+    }
+}
+
+
+/// open_socket binds and listens on a socket at path, replacing a stale
+/// socket but nothing else. returns the socket, or -1.
+static int open_socket(const char * path) {
+    struct sockaddr_un address;
+    struct stat info;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return (-1);
+    }
+    if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return (-1);
+    }
+    if (bind(fd, (struct sockaddr *)(&address), sizeof(address)) != 0
+        || listen(fd, VLC_BACKLOG) != 0) {
+        close(fd);
+        return (-1);
+    }
+    return (fd);
+}
+
+
+/// vlc_serve answers requests on a socket until it is told to stop.
+///
+int vlc_serve(const char * path, size_t workers, int verbose) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    /// a client that hangs up early must not kill the server.
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+
+    int listener = open_socket(path);
+    if (listener < 0) {
+        return (-1);
+    }
+    workers = workers > 0 ? workers : 1;
+    Server server;
+    memset(&server, 0, sizeof(server));
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.ready, NULL);
+    server.trained = malloc(sizeof(VlcCoder));
+    int * idle = malloc(VLC_MAX_CLIENTS * sizeof(int));
+    Worker * pool = calloc(workers, sizeof(Worker));
+    int status = server.trained == NULL || idle == NULL || pool == NULL
+                 || pipe(server.wake) != 0 ? -1 : 0;
+    if (status == 0) {
+        fcntl(server.wake[0], F_SETFL, O_NONBLOCK);
+        fcntl(server.wake[1], F_SETFL, O_NONBLOCK);
+    } else {
+        server.wake[0] = server.wake[1] = -1;
+    }
+    for (size_t i = 0; i < workers && status == 0; i ++) {
+        pool[i].server = &server;
+        if (context_init(&pool[i].context) != 0) {
+            status = -1;
+            break;
+        }
+        pool[i].started = pthread_create(&pool[i].thread, NULL, work_loop,
+                                         &pool[i]) == 0;
+        if (!pool[i].started) {
+            status = -1;
+        }
+    }
+    if (status == 0) {
+        poll_clients(&server, listener, idle);
+    }
+
+    /// connections still queued are dropped; those being answered finish
+    /// their current request and are closed once it is done.
+    pthread_mutex_lock(&server.lock);
+    server.done = 1;
+    while (server.count > 0) {
+        close(server.pending[server.head]);
+        server.head = (server.head + 1) % VLC_MAX_CLIENTS;
+        server.count --;
+    }
+    pthread_cond_broadcast(&server.ready);
+    pthread_mutex_unlock(&server.lock);
+    for (size_t i = 0; pool != NULL && i < workers; i ++) {
+        if (pool[i].started) {
+            pthread_join(pool[i].thread, NULL);
+        }
+        if (verbose) {
+            fprintf(stderr, "worker %zu:\t%zu requests, %zu cached headers\n",
+                    i, pool[i].context.requests, pool[i].context.cached);
+        }
+        context_free(&pool[i].context);
+    }
+    while (server.answered_count > 0) {
+        close(server.answered[-- server.answered_count]);
+    }
+    if (server.wake[0] >= 0) {
+        close(server.wake[0]);
+        close(server.wake[1]);
+    }
+    close(listener);
+    unlink(path);
+    free(pool);
+    free(idle);
+    free(server.trained);
+    pthread_cond_destroy(&server.ready);
+    pthread_mutex_destroy(&server.lock);
+    return (status);
+}
+
+
+/// vlc_connect opens a connection to a server.
+///
+int vlc_connect(const char * path) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return (-1);
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return (-1);
+    }
+    if (connect(fd, (struct sockaddr *)(&address), sizeof(address)) != 0) {
+        close(fd);
+        return (-1);
+    }
+    return (fd);
+}
+
+
+/// vlc_call sends one request and waits for its response.
+///
+int vlc_call(int fd, int op, int flags, int streams, int policy,
+             const unsigned char * payload, size_t length,
+             unsigned char ** reply, size_t * capacity,
+             size_t * reply_length) {
+    unsigned char header[VLC_REQUEST];
+    header[0] = (unsigned char)(op);
+    header[1] = (unsigned char)(flags);
+    header[2] = (unsigned char)(streams);
+    header[3] = (unsigned char)(policy);
+    put_u32(header + 4, (uint32_t)(length));
+    unsigned char response[VLC_RESPONSE];
+    if (length > VLC_MAX_PAYLOAD
+        || write_full(fd, header, VLC_REQUEST) != 0
+        || write_full(fd, payload, length) != 0
+        || read_full(fd, response, VLC_RESPONSE) != 0) {
+        return (-1);
+    }
+    *reply_length = get_u32(response + 1);
+    if (vlc_reserve(reply, capacity, *reply_length + 1) != 0
+        || read_full(fd, *reply, *reply_length) != 0) {
+        return (-1);
+    }
+    return (response[0]);
+}
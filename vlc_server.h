@@ -0,0 +1,97 @@
+/// file: vlc_server.h
+/// author: gabe rippel, gwr3294@rit.edu
+///
+/// a long-running coder that answers requests over a Unix domain socket.
+/// each worker thread keeps its heap, code tables and block buffers warm
+/// between requests, so a request costs its coding and nothing else.
+///
+/// every request is a VLC_REQUEST byte header followed by its payload:
+/// the op, its flags, a stream count and a policy (0 for the defaults),
+/// then the payload length as a little-endian u32. every response is a
+/// VLC_RESPONSE byte header (a status, then the length) and its payload;
+/// a failed request answers with a message instead. a connection may
+/// carry any number of requests, one after the other, and holds no
+/// worker while it waits between them; a request that stalls part way
+/// is dropped with its connection after a few seconds.
+
+#ifndef VLC_SERVER_H
+#define VLC_SERVER_H
+
+#include <stddef.h>
+
+/// VLC_REQUEST is the size of a request header.
+///
+#define VLC_REQUEST   8
+
+/// VLC_RESPONSE is the size of a response header.
+///
+#define VLC_RESPONSE   5
+
+/// VLC_MAX_PAYLOAD is the largest payload a request or a response may
+/// carry. A DECODE whose input would decode to more than this is
+/// answered with an error, since well-compressed input can expand far
+/// past it, and so is an ENCODE whose output would, which takes input
+/// near the limit that does not compress.
+///
+#define VLC_MAX_PAYLOAD   (64u << 20)
+
+/// Requests:
+/// <ul><li>ENCODE codes the payload and answers with what -e would write,
+/// <li>DECODE undoes ENCODE, and
+/// <li>ANALYZE answers with a summary of the payload's code.</ul>
+///
+#define VLC_OP_ENCODE    'e'
+#define VLC_OP_DECODE    'd'
+#define VLC_OP_ANALYZE   'a'
+
+/// Request flags:
+/// <ul><li>LINES and BWT ask ENCODE for -l and -t,
+/// <li>TRAINED has ENCODE use the server's trained tables instead of
+/// building a code from the payload, and
+/// <li>TRAIN has ANALYZE keep the payload's code as the trained tables.</ul>
+///
+#define VLC_FLAG_LINES     0x01
+#define VLC_FLAG_BWT       0x02
+#define VLC_FLAG_TRAINED   0x04
+#define VLC_FLAG_TRAIN     0x08
+
+/// Response statuses.
+///
+#define VLC_STATUS_OK      0
+#define VLC_STATUS_ERROR   1
+
+/// vlc_serve answers requests on a socket at path until it is sent
+/// SIGINT or SIGTERM. A stale socket left at path is replaced.
+/// @param path file name of the socket
+/// @param workers number of requests answered at once, at least 1; any
+/// number of connections may stay open between requests
+/// @param verbose 1 to report the requests each worker served on exit
+/// @return 0 on a clean shutdown, -1 if the socket cannot be set up
+///
+int vlc_serve( const char * path, size_t workers, int verbose );
+
+/// vlc_connect opens a connection to a server.
+/// @param path file name of the server's socket
+/// @return the connected socket, or -1
+///
+int vlc_connect( const char * path );
+
+/// vlc_call sends one request and waits for its response.
+/// @param fd socket from vlc_connect
+/// @param op one of the VLC_OP values
+/// @param flags VLC_FLAG values or'ed together
+/// @param streams bitstreams per block, or 0 for the default
+/// @param policy VLC_POLICY value plus one, or 0 for the default
+/// @param payload the request payload
+/// @param length number of bytes in payload, at most VLC_MAX_PAYLOAD
+/// @param reply malloc'd buffer (or NULL) grown to hold the response
+/// @param capacity number of bytes *reply has room for, updated as it grows
+/// @param reply_length set to the number of bytes in the response
+/// @return the response status, or -1 on an I/O error
+///
+int vlc_call( int fd, int op, int flags, int streams, int policy,
+              const unsigned char * payload, size_t length,
+              unsigned char ** reply, size_t * capacity,
+              size_t * reply_length );
+
+#endif // VLC_SERVER_H